@@ -0,0 +1,134 @@
+// Benchmark: codec de quadros (src/frame_codec.hpp) em mundos realistas.
+//
+// Para cada densidade inicial, simula alguns ticks para o mundo se organizar
+// (manchas de plantas, predadores espalhados) e mede, no quadro inteiro e nas
+// mudancas de um tick para o seguinte, a taxa de compressao e a vazao de
+// codificacao e decodificacao (MB/s de grade sem compressao). O delta sem
+// compressao e o formato da trajetoria antiga (varint + 4 bytes por celula).
+// Todo bloco e decodificado e conferido com a grade original.
+//
+//   ./codec_bench [--rows 512] [--warmup 50] [--repeat 20]
+
+#include "ecosim.hpp"
+#include "frame_codec.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const char *option(int argc, char **argv, const char *name, const char *fallback)
+{
+    for (int k = 1; k + 1 < argc; k++)
+    {
+        if (std::strcmp(argv[k], name) == 0) return argv[k + 1];
+    }
+    return fallback;
+}
+
+struct density_t
+{
+    const char *name;
+    uint32_t plants, herbivores, carnivores;
+};
+
+//Segundos por repeticao de f
+template <class F>
+static double timeIt(uint32_t repeat, F &&f)
+{
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t k = 0; k < repeat; k++) f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() / repeat;
+}
+
+static std::vector<cell_t> rowMajor(const world_t &w)
+{
+    std::vector<cell_t> cells;
+    cells.reserve((size_t)w.rows * w.cols);
+    for (uint32_t i = 0; i < w.rows; i++)
+    {
+        for (uint32_t j = 0; j < w.cols; j++) cells.push_back(w.at(i, j));
+    }
+    return cells;
+}
+
+static void report(const char *world, const char *what, size_t raw, size_t packed, double rawBytes, double encode, double decode)
+{
+    std::printf("%-8s %-7s %12zu %12zu %8.2fx %10.0f %10.0f\n", world, what, raw, packed, (double)raw / packed, rawBytes / encode / 1e6,
+                rawBytes / decode / 1e6);
+    std::fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t rows = std::stoul(option(argc, argv, "--rows", "512"));
+    uint32_t warmup = std::stoul(option(argc, argv, "--warmup", "50"));
+    uint32_t repeat = std::stoul(option(argc, argv, "--repeat", "20"));
+    size_t cells = (size_t)rows * rows;
+    const density_t densities[] = {{"sparse", (uint32_t)(cells / 50), (uint32_t)(cells / 200), (uint32_t)(cells / 1000)},
+                                   {"default", (uint32_t)(cells * 30 / 100), (uint32_t)(cells * 8 / 100), (uint32_t)(cells * 2 / 100)},
+                                   {"dense", (uint32_t)(cells * 70 / 100), (uint32_t)(cells * 10 / 100), (uint32_t)(cells * 2 / 100)}};
+
+    frame_codec::frame_encoder_t encoder;
+    frame_codec::frame_decoder_t decoder;
+    std::vector<uint8_t> block;
+    bool ok = true;
+
+    std::printf("%-8s %-7s %12s %12s %9s %10s %10s\n", "world", "block", "raw bytes", "packed", "ratio", "enc MB/s", "dec MB/s");
+    for (const density_t &d : densities)
+    {
+        world_t w(rows, rows);
+        w.reset(42);
+        startEcoSim(w, d.plants, d.herbivores, d.carnivores);
+        for (uint32_t t = 0; t < warmup; t++) nextIteration(w);
+
+        //Quadro inteiro
+        std::vector<cell_t> before = rowMajor(w), decoded(cells);
+        auto encodeFrame = [&] {
+            block.clear();
+            encoder.beginFrame(cells);
+            for (cell_t c : before) encoder.add(c);
+            encoder.end(block);
+        };
+        auto decodeFrame = [&] {
+            size_t k = 0;
+            decoder.frame(block.data(), block.size(), cells, [&](cell_t c) { decoded[k++] = c; });
+        };
+        double encode = timeIt(repeat, encodeFrame), decode = timeIt(repeat, decodeFrame);
+        ok &= std::memcmp(decoded.data(), before.data(), cells * sizeof(cell_t)) == 0;
+        report(d.name, "frame", cells * sizeof(cell_t), block.size(), cells * sizeof(cell_t), encode, decode);
+
+        //Mudancas de um tick
+        nextIteration(w);
+        std::vector<cell_t> after = rowMajor(w);
+        size_t raw = 0, changed = 0;
+        for (size_t k = 0, next = 0; k < cells; k++)
+        {
+            if (after[k].bits == before[k].bits) continue;
+            raw += frame_codec::varintBytes(k - next) + sizeof(cell_t);
+            next = k + 1;
+            changed++;
+        }
+        auto encodeChanges = [&] {
+            block.clear();
+            encoder.beginChanges(cells);
+            for (size_t k = 0; k < cells; k++)
+            {
+                if (after[k].bits != before[k].bits) encoder.change(k, after[k], before[k]);
+            }
+            encoder.end(block);
+        };
+        auto decodeChanges = [&] {
+            decoded = before;
+            decoder.changes(block.data(), block.size(), cells, [&](uint64_t k) -> cell_t & { return decoded[k]; });
+        };
+        encode = timeIt(repeat, encodeChanges);
+        decode = timeIt(repeat, decodeChanges);
+        ok &= std::memcmp(decoded.data(), after.data(), cells * sizeof(cell_t)) == 0;
+        report(d.name, "delta", raw, block.size(), cells * sizeof(cell_t), encode, decode);
+        std::printf("%-8s %-7s %zu of %zu cells changed\n", "", "", changed, cells);
+    }
+    if (!ok) std::printf("round trip MISMATCH\n");
+    return ok ? 0 : 1;
+}
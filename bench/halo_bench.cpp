@@ -0,0 +1,99 @@
+// Benchmark: largura do halo (ticks entre trocas) x custo de sincronizacao.
+//
+// Para cada tamanho de mundo e particao, roda o motor em threads (--tiled) e em
+// processos com sockets Unix (--distributed) variando k = ticks entre trocas
+// (halo de k * TICK_RADIUS celulas). Trocas menos frequentes economizam
+// latencia de sincronizacao, mas cada subdominio recalcula uma borda maior.
+//
+//   ./halo_bench [--rows 512] [--layout 2x2] [--ticks 200]
+
+#include "distributed.hpp"
+#include "tiled.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+
+static const char *option(int argc, char **argv, const char *name, const char *fallback)
+{
+    for (int k = 1; k + 1 < argc; k++)
+    {
+        if (std::strcmp(argv[k], name) == 0) return argv[k + 1];
+    }
+    return fallback;
+}
+
+static world_t makeWorld(uint32_t rows, uint32_t cols)
+{
+    world_t w(rows, cols);
+    w.reset(42);
+    size_t cells = (size_t)rows * cols;
+    startEcoSim(w, cells * 30 / 100, cells * 8 / 100, cells * 2 / 100);
+    return w;
+}
+
+//Celulas recalculadas por tick em relacao as celulas proprias (halo redundante),
+//em media ao longo dos k ticks entre trocas, ja que a regiao valida encolhe
+static double redundancy(const std::vector<rect_t> &layout, uint32_t k, uint32_t rows, uint32_t cols)
+{
+    size_t computed = 0;
+    for (const rect_t &r : layout)
+    {
+        for (uint32_t s = 0; s < k; s++) computed += expand(r, haloWidth(k) - s * TICK_RADIUS, rows, cols).area();
+    }
+    return (double)computed / ((size_t)rows * cols * k) - 1.0;
+}
+
+static double run(partitioned_engine_t &engine, const world_t &initial, uint32_t ticks)
+{
+    world_t w = initial;
+    engine.load(w);
+    engine.step(std::min<uint32_t>(ticks / 10 + 1, 20));
+
+    auto begin = std::chrono::steady_clock::now();
+    engine.step(ticks);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return ticks / seconds;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t ticks = std::stoul(option(argc, argv, "--ticks", "200"));
+    std::string only = option(argc, argv, "--rows", "");
+    std::string layoutText = option(argc, argv, "--layout", "2x2");
+    unsigned pr = 2, pc = 2;
+    std::sscanf(layoutText.c_str(), "%ux%u", &pr, &pc);
+
+    std::vector<uint32_t> sizes = {64, 256, 1024};
+    if (!only.empty()) sizes = {(uint32_t)std::stoul(only)};
+    const uint32_t ks[] = {1, 2, 3, 4, 6, 8};
+
+    std::printf("%-6s %-8s %-8s %3s %10s %12s %10s\n", "rows", "layout", "engine", "k", "redundant", "exchanges/t", "ticks/s");
+    for (uint32_t rows : sizes)
+    {
+        world_t initial = makeWorld(rows, rows);
+        std::vector<rect_t> layout = partitionGrid(rows, rows, pr, pc);
+
+        for (int processes = 0; processes < 2; processes++)
+        {
+            for (uint32_t k : ks)
+            {
+                if (haloWidth(k) > rows / std::max(pr, pc)) continue;
+
+                std::unique_ptr<partitioned_engine_t> engine;
+                if (processes)
+                    engine.reset(new cluster_t("unix:/tmp/ecosim-halo-bench-" + std::to_string(::getpid()) + ".sock", layout, true, k));
+                else
+                    engine.reset(new tiled_engine_t(layout, k, (unsigned)layout.size()));
+
+                double rate = run(*engine, initial, ticks);
+                std::printf("%-6u %-8s %-8s %3u %9.1f%% %12.3f %10.1f\n", rows, layoutText.c_str(), processes ? "process" : "thread", k,
+                            100.0 * redundancy(layout, k, rows, rows), 1.0 / k, rate);
+                std::fflush(stdout);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,118 @@
+// Benchmark: layout da grade (linhas x ladrilhos de Morton) em mundos grandes.
+//
+// Para cada tamanho de mundo, roda o tick sequencial nos dois layouts e mede
+// ticks/s e, quando o kernel permite (perf_event_open), as faltas de leitura
+// na cache L1 de dados e na ultima cache (LLC) por tick. Os dois layouts geram
+// exatamente o mesmo mundo; o hash final e conferido.
+//
+//   ./layout_bench [--rows 2048] [--ticks 20]
+
+#include "ecosim.hpp"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+static const char *option(int argc, char **argv, const char *name, const char *fallback)
+{
+    for (int k = 1; k + 1 < argc; k++)
+    {
+        if (std::strcmp(argv[k], name) == 0) return argv[k + 1];
+    }
+    return fallback;
+}
+
+//Contador de hardware do proprio processo, ou -1 se indisponivel
+static int openCounter(uint64_t cache)
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t readCounter(int fd)
+{
+    uint64_t value = 0;
+    if (fd < 0 || ::read(fd, &value, sizeof(value)) != sizeof(value)) return 0;
+    return value;
+}
+
+struct result_t
+{
+    double rate;
+    double l1_misses;
+    double llc_misses;
+    uint64_t hash;
+};
+
+static result_t run(grid_layout_t layout, uint32_t rows, uint32_t ticks)
+{
+    world_t w;
+    w.layout = layout;
+    w.resize(rows, rows);
+    w.reset(42);
+    size_t cells = (size_t)rows * rows;
+    startEcoSim(w, cells * 30 / 100, cells * 8 / 100, cells * 2 / 100);
+    nextIteration(w);
+
+    int l1 = openCounter(PERF_COUNT_HW_CACHE_L1D), llc = openCounter(PERF_COUNT_HW_CACHE_LL);
+    for (int fd : {l1, llc})
+    {
+        if (fd < 0) continue;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t t = 0; t < ticks; t++) nextIteration(w);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    result_t r{ticks / seconds, -1, -1, gridHash(w)};
+    if (l1 >= 0) r.l1_misses = (double)readCounter(l1) / ticks, ::close(l1);
+    if (llc >= 0) r.llc_misses = (double)readCounter(llc) / ticks, ::close(llc);
+    return r;
+}
+
+static std::string perTick(double misses)
+{
+    if (misses < 0) return "n/a";
+    char text[32];
+    std::snprintf(text, sizeof text, "%.2fM", misses / 1e6);
+    return text;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t ticks = std::stoul(option(argc, argv, "--ticks", "20"));
+    std::string only = option(argc, argv, "--rows", "");
+    std::vector<uint32_t> sizes = {512, 1024, 2048};
+    if (!only.empty()) sizes = {(uint32_t)std::stoul(only)};
+
+    std::printf("%-6s %-10s %10s %14s %14s %s\n", "rows", "layout", "ticks/s", "L1D miss/tick", "LLC miss/tick", "hash");
+    for (uint32_t rows : sizes)
+    {
+        uint64_t reference = 0;
+        for (grid_layout_t layout : {layout_row_major, layout_morton})
+        {
+            result_t r = run(layout, rows, ticks);
+            if (layout == layout_row_major) reference = r.hash;
+            std::printf("%-6u %-10s %10.2f %14s %14s %016llx%s\n", rows, layout == layout_row_major ? "row-major" : "morton", r.rate,
+                        perTick(r.l1_misses).c_str(), perTick(r.llc_misses).c_str(), (unsigned long long)r.hash,
+                        r.hash == reference ? "" : " MISMATCH");
+            std::fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,190 @@
+// Benchmark: paginas enormes e posicionamento NUMA da grade em mundos grandes.
+//
+// Para cada modo de paginas (normais, transparentes, explicitas) roda o tick
+// paralelo com o pool livre e com o pool pinned (grade realocada pelas threads
+// donas de cada faixa) e mede:
+//   - ticks/s;
+//   - faltas de leitura na dTLB por tick, quando o kernel permite perf_event_open;
+//   - quanto da grade esta em paginas enormes (/proc/self/smaps);
+//   - a fracao das paginas da grade que esta no no NUMA da thread que processa
+//     a faixa dela (move_pages), ou seja, quanto do tick le memoria local.
+// Todas as configuracoes geram o mesmo mundo; o hash final e conferido.
+//
+//   ./memory_bench [--rows 4096] [--ticks 10] [--threads N]
+
+#include "parallel.hpp"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+static const char *option(int argc, char **argv, const char *name, const char *fallback)
+{
+    for (int k = 1; k + 1 < argc; k++)
+    {
+        if (std::strcmp(argv[k], name) == 0) return argv[k + 1];
+    }
+    return fallback;
+}
+
+//Faltas de leitura na dTLB do proprio processo (todas as threads), ou -1 se indisponivel
+static int openCounter()
+{
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static uint64_t readCounter(int fd)
+{
+    uint64_t value = 0;
+    if (fd < 0 || ::read(fd, &value, sizeof(value)) != sizeof(value)) return 0;
+    return value;
+}
+
+//Fracao do mapeamento que contem p em paginas enormes (transparentes ou
+//hugetlbfs). Buffers vizinhos com o mesmo modo podem formar um unico mapeamento.
+static double hugeFraction(const void *p)
+{
+    std::ifstream smaps("/proc/self/smaps");
+    std::string line;
+    bool inside = false;
+    uint64_t size = 0, anonHuge = 0, pageKb = 4;
+    uintptr_t addr = (uintptr_t)p;
+    while (std::getline(smaps, line))
+    {
+        unsigned long lo, hi;
+        if (std::sscanf(line.c_str(), "%lx-%lx ", &lo, &hi) == 2 && line.find(':') > line.find(' '))
+        {
+            if (inside) break;
+            inside = addr >= lo && addr < hi;
+            continue;
+        }
+        if (!inside) continue;
+        std::istringstream in(line);
+        std::string key;
+        uint64_t kb = 0;
+        in >> key >> kb;
+        if (key == "Size:") size = kb;
+        if (key == "AnonHugePages:") anonHuge = kb;
+        if (key == "KernelPageSize:") pageKb = kb;
+    }
+    if (size == 0) return -1;
+    return pageKb >= 2048 ? 1.0 : (double)anonHuge / size;
+}
+
+//Fracao das paginas da grade no no da thread dona da faixa (-1 sem move_pages)
+static double localFraction(const world_t &w, const thread_pool_t &pool)
+{
+    const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t bands = (w.rows + BAND_ROWS - 1) / BAND_ROWS, local = 0, total = 0;
+    std::vector<int> nodeOfThread(pool.size());
+    for (unsigned t = 0; t < pool.size(); t++) nodeOfThread[t] = topology::nodeOfCpu(pool.cpuOf(t) < 0 ? 0 : pool.cpuOf(t));
+
+    for (size_t b = 0; b < bands; b++)
+    {
+        uint32_t r0 = (uint32_t)b * BAND_ROWS, r1 = std::min(r0 + BAND_ROWS, w.rows);
+        uintptr_t begin = (uintptr_t)(w.entity_grid.data() + w.rowStart(r0)), end = (uintptr_t)(w.entity_grid.data() + w.rowStart(r1));
+        std::vector<void *> pages;
+        for (uintptr_t a = begin & ~(uintptr_t)(page - 1); a < end; a += page) pages.push_back((void *)a);
+        std::vector<int> status(pages.size(), -1);
+        if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr, status.data(), 0) != 0) return -1;
+
+        int want = nodeOfThread[pool.ownerOf(b, bands)];
+        for (int s : status)
+        {
+            local += s == want;
+            total += s >= 0;
+        }
+    }
+    return total ? (double)local / total : -1;
+}
+
+struct result_t
+{
+    double rate;
+    double tlb_misses;
+    double huge_fraction;
+    double local_fraction;
+    uint64_t hash;
+};
+
+static result_t run(grid_memory::huge_pages_t mode, bool pinned, uint32_t rows, uint32_t ticks, unsigned threads)
+{
+    grid_memory::policy() = mode;
+    thread_pool_t pool(threads, pinned);
+    world_t w(rows, rows);
+    w.reset(42);
+    size_t cells = (size_t)rows * rows;
+    startEcoSim(w, cells * 30 / 100, cells * 8 / 100, cells * 2 / 100);
+    if (pinned) placeWorld(w, pool);
+    nextIterationParallel(w, pool);
+
+    int tlb = openCounter();
+    if (tlb >= 0)
+    {
+        ioctl(tlb, PERF_EVENT_IOC_RESET, 0);
+        ioctl(tlb, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t t = 0; t < ticks; t++) nextIterationParallel(w, pool);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    result_t r{ticks / seconds, -1, hugeFraction(w.entity_grid.data()), localFraction(w, pool), gridHash(w)};
+    if (tlb >= 0) r.tlb_misses = (double)readCounter(tlb) / ticks, ::close(tlb);
+    return r;
+}
+
+static std::string fraction(double f)
+{
+    if (f < 0) return "n/a";
+    char text[32];
+    std::snprintf(text, sizeof text, "%.0f%%", f * 100);
+    return text;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t rows = std::stoul(option(argc, argv, "--rows", "4096"));
+    uint32_t ticks = std::stoul(option(argc, argv, "--ticks", "10"));
+    unsigned threads = std::stoul(option(argc, argv, "--threads", std::to_string(std::thread::hardware_concurrency()).c_str()));
+    std::vector<int> cpus = topology::cpusByNode();
+    std::printf("%u threads, %zu CPUs, last CPU on node %d\n", threads, cpus.size(), topology::nodeOfCpu(cpus.back()));
+
+    std::printf("%-9s %-7s %10s %14s %8s %8s %s\n", "pages", "pool", "ticks/s", "dTLB miss/tick", "huge", "local", "hash");
+    const char *names[] = {"normal", "thp", "explicit"};
+    uint64_t reference = 0;
+    for (grid_memory::huge_pages_t mode : {grid_memory::huge_off, grid_memory::huge_transparent, grid_memory::huge_explicit})
+    {
+        for (bool pinned : {false, true})
+        {
+            uint64_t fallbacks = grid_memory::usage().explicit_fallbacks.load();
+            result_t r = run(mode, pinned, rows, ticks, threads);
+            if (!reference) reference = r.hash;
+            char misses[32] = "n/a";
+            if (r.tlb_misses >= 0) std::snprintf(misses, sizeof misses, "%.2fM", r.tlb_misses / 1e6);
+            std::printf("%-9s %-7s %10.2f %14s %8s %8s %016llx%s%s\n", names[mode], pinned ? "pinned" : "free", r.rate, misses,
+                        fraction(r.huge_fraction).c_str(), fraction(r.local_fraction).c_str(), (unsigned long long)r.hash,
+                        r.hash == reference ? "" : " MISMATCH",
+                        grid_memory::usage().explicit_fallbacks.load() > fallbacks ? " (no hugetlbfs pages: fell back to thp)" : "");
+            std::fflush(stdout);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+#include "arena.hpp"
+#include "ecosim.hpp"
+#include "tracking.hpp"
+
+#include <algorithm>
+#include <vector>
+
+//Tick esparso: em vez de varrer a grade inteira, as fases percorrem a lista
+//de celulas vivas (e as celulas vazias que elas disputam). Os planos de
+//intencoes e vencedores ficam vazios fora dessas celulas, e a grade seguinte
+//fica vazia fora das celulas escritas, entao o resultado e identico ao de
+//nextIteration. Nascimentos e movimentos embaralham a lista aos poucos; a cada
+//resort_ticks ticks ela e reordenada (radix sort) pelo indice na memoria, que
+//no layout de Morton ja e a chave da curva de preenchimento.
+//
+//Depois da troca dos buffers, a grade seguinte ainda guarda os seres do tick
+//anterior; eles so sao apagados no inicio do proximo step, depois do
+//beforeTick do escritor de checkpoints (o buffer pode ser o de um checkpoint
+//em andamento).
+class active_ticker_t
+{
+public:
+    //Distancia (em seres) do prefetch da vizinhanca durante a fase de decisao
+    static const size_t PREFETCH_DISTANCE = 8;
+
+    explicit active_ticker_t(uint32_t resortTicks = 16) : resort_ticks(resortTicks ? resortTicks : 1) {}
+
+    size_t live() const { return list.size(); }
+    uint64_t resorts() const { return resort_count; }
+
+    //Monta a lista a partir da grade (em ordem de memoria) e limpa os planos auxiliares
+    void attach(world_t &w)
+    {
+        list.clear();
+        for (uint32_t i = 0; i < w.rows; i++)
+        {
+            for (uint32_t j = 0; j < w.cols; j++)
+            {
+                if (cellType(w.at(i, j)) != entity_type_t::empty) list.push_back({i, j});
+            }
+        }
+        sortList(w);
+        next_list.clear();
+        std::fill(w.next_grid.begin(), w.next_grid.end(), EMPTY_CELL);
+        std::fill(w.claims.begin(), w.claims.end(), claim_none);
+        std::fill(w.winners.begin(), w.winners.end(), NO_WINNER);
+        attached_tick = w.tick;
+        attached_cells = w.entity_grid.size();
+    }
+
+    bool attached(const world_t &w) const { return attached_tick == w.tick && attached_cells == w.entity_grid.size(); }
+
+    void step(world_t &w, entity_tracker_t *tracker = nullptr)
+    {
+        using namespace ecosim;
+        if (!attached(w))
+            attach(w);
+        else
+        {
+            //A grade antiga virou a proxima grade: apaga os seres que estavam nela
+            for (pos_t p : next_list) w.next_grid[w.index(p.i, p.j)] = EMPTY_CELL;
+        }
+
+        for (size_t k = 0; k < list.size(); k++)
+        {
+            if (k + PREFETCH_DISTANCE < list.size()) prefetch(w, list[k + PREFETCH_DISTANCE]);
+            pos_t p = list[k];
+            w.claims[w.index(p.i, p.j)] = decide(w, p.i, p.j);
+        }
+
+        for (pos_t p : list)
+        {
+            uint8_t claim = w.claims[w.index(p.i, p.j)];
+            if (claimKind(claim) == claim_none) continue;
+            int I = p.i + DI[claimDir(claim)], J = p.j + DJ[claimDir(claim)];
+            w.winners[w.index(I, J)] = resolve(w, I, J);
+        }
+
+        //Cada celula vazia disputada e composta uma unica vez, pelo vencedor
+        tick_counts_t counts;
+        next_list.clear();
+        for (pos_t p : list)
+        {
+            size_t k = w.index(p.i, p.j);
+            w.next_grid[k] = apply(w, p.i, p.j, counts);
+            if (cellType(w.next_grid[k]) != entity_type_t::empty)
+                next_list.push_back(p);
+            else
+                w.touch(p.i, p.j);
+
+            uint8_t claim = w.claims[k];
+            claim_kind_t kind = claimKind(claim);
+            if ((kind == claim_move || kind == claim_birth) && claimWon(w, p.i, p.j, claim))
+            {
+                pos_t t = {p.i + DI[claimDir(claim)], p.j + DJ[claimDir(claim)]};
+                size_t kt = w.index(t.i, t.j);
+                w.next_grid[kt] = apply(w, t.i, t.j, counts);
+                if (cellType(w.next_grid[kt]) != entity_type_t::empty)
+                {
+                    next_list.push_back(t);
+                    w.touch(t.i, t.j);
+                }
+            }
+        }
+        if (tracker) tracker->update(w);
+
+        for (pos_t p : list)
+        {
+            size_t k = w.index(p.i, p.j);
+            uint8_t claim = w.claims[k];
+            if (claimKind(claim) != claim_none) w.winners[w.index(p.i + DI[claimDir(claim)], p.j + DJ[claimDir(claim)])] = NO_WINNER;
+            w.claims[k] = claim_none;
+        }
+        finishTick(w, counts);
+
+        //next_list fica com os seres da grade antiga, apagados no proximo step
+        list.swap(next_list);
+        attached_tick = w.tick;
+
+        if (w.tick % resort_ticks == 0) sortList(w);
+    }
+
+private:
+    void prefetch(const world_t &w, pos_t p) const
+    {
+        __builtin_prefetch(&w.entity_grid[w.index(p.i, p.j)]);
+        if (p.i > 0) __builtin_prefetch(&w.entity_grid[w.index(p.i - 1, p.j)]);
+        if (p.i + 1 < w.rows) __builtin_prefetch(&w.entity_grid[w.index(p.i + 1, p.j)]);
+    }
+
+    //Radix sort LSD (8 bits por passada) pelo indice na memoria. As chaves e
+    //as copias de cada passada vem da arena da thread, reservada pela
+    //capacidade das listas: ela so cresce quando as listas crescem.
+    void sortList(const world_t &w)
+    {
+        size_t n = list.size();
+        arena_t &arena = tickArena();
+        arena.reserve(std::max(list.capacity(), next_list.capacity()) * (2 * sizeof(uint32_t) + sizeof(pos_t)) + 3 * alignof(std::max_align_t));
+        uint32_t *keys = arena.make<uint32_t>(n), *key_scratch = arena.make<uint32_t>(n);
+        pos_t *items = list.data(), *pos_scratch = arena.make<pos_t>(n);
+        for (size_t k = 0; k < n; k++) keys[k] = (uint32_t)w.index(list[k].i, list[k].j);
+
+        for (uint32_t shift = 0; shift < 32; shift += 8)
+        {
+            size_t counts[257] = {0};
+            for (size_t k = 0; k < n; k++) counts[((keys[k] >> shift) & 0xFF) + 1]++;
+            if (counts[((n ? keys[0] : 0) >> shift & 0xFF) + 1] == n) continue;
+            for (int b = 0; b < 256; b++) counts[b + 1] += counts[b];
+            for (size_t k = 0; k < n; k++)
+            {
+                size_t to = counts[(keys[k] >> shift) & 0xFF]++;
+                key_scratch[to] = keys[k];
+                pos_scratch[to] = items[k];
+            }
+            std::swap(keys, key_scratch);
+            std::swap(items, pos_scratch);
+        }
+        if (items != list.data()) std::copy(items, items + n, list.data());
+        arena.reset();
+        resort_count++;
+    }
+
+    uint32_t resort_ticks;
+    std::vector<pos_t> list;
+    std::vector<pos_t> next_list;
+    uint64_t attached_tick = UINT64_MAX;
+    size_t attached_cells = 0;
+    uint64_t resort_count = 0;
+};
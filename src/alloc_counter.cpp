@@ -0,0 +1,22 @@
+#include "alloc_counter.hpp"
+
+#include <cstdlib>
+#include <new>
+
+//Substitui operator new/delete por versoes que contam as alocacoes. Fica em
+//uma unidade de traducao propria, ligada so ao ecosim_check: assim o servidor
+//nao paga o contador, e as versoes com free nunca sao expandidas junto de
+//quem recebeu o ponteiro do operator new padrao.
+
+void *operator new(std::size_t size)
+{
+    alloc_counter::counter().fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void *p, std::size_t) noexcept { std::free(p); }
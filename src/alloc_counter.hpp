@@ -0,0 +1,28 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+//Contador global de alocacoes no heap, para verificar que os ticks em regime
+//nao alocam. So conta no programa ecosim_check, que e ligado com
+//alloc_counter.cpp (a versao de operator new/delete que conta) e compilado com
+//ECOSIM_COUNT_ALLOCATIONS; o servidor usa o operator new padrao.
+namespace alloc_counter
+{
+    inline std::atomic<uint64_t> &counter()
+    {
+        static std::atomic<uint64_t> count{0};
+        return count;
+    }
+
+    inline uint64_t allocations() { return counter().load(std::memory_order_relaxed); }
+
+    inline bool enabled()
+    {
+#ifdef ECOSIM_COUNT_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+//Alocador de pilha para dados temporarios de um tick: allocate so avanca um
+//ponteiro e reset devolve tudo de uma vez. Quando o bloco nao basta, blocos
+//extras sao pedidos ao heap e, no reset, o bloco principal cresce ate o maior
+//uso visto (pelo menos dobrando, como um vetor, para que um uso que sobe aos
+//poucos nao realoque a cada tick); a partir dai os ticks seguintes nao alocam
+//mais nada.
+class arena_t
+{
+public:
+    explicit arena_t(size_t capacity = 0) { grow(capacity); }
+
+    arena_t(const arena_t &) = delete;
+    arena_t &operator=(const arena_t &) = delete;
+    arena_t(arena_t &&) = default;
+    arena_t &operator=(arena_t &&) = default;
+
+    //O alinhamento vale para o endereco devolvido, qualquer que seja o do bloco
+    void *allocate(size_t bytes, size_t align = alignof(std::max_align_t))
+    {
+        uintptr_t base = reinterpret_cast<uintptr_t>(block.get());
+        size_t start = (size_t)(((base + offset + align - 1) & ~(uintptr_t)(align - 1)) - base);
+        if (block && start + bytes <= size)
+        {
+            offset = start + bytes;
+            high_water = std::max(high_water, offset + spilled);
+            return block.get() + start;
+        }
+
+        //Nao coube: bloco extra so ate o proximo reset
+        spilled += bytes + align;
+        high_water = std::max(high_water, offset + spilled);
+        overflow.emplace_back(new char[bytes + align]);
+        uintptr_t p = reinterpret_cast<uintptr_t>(overflow.back().get());
+        return reinterpret_cast<void *>((p + align - 1) & ~(uintptr_t)(align - 1));
+    }
+
+    //Vetor de n objetos triviais, sem inicializacao
+    template <typename T>
+    T *make(size_t n)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void reset()
+    {
+        if (!overflow.empty())
+        {
+            overflow.clear();
+            grow(std::max(high_water, 2 * size));
+        }
+        offset = 0;
+        spilled = 0;
+    }
+
+    //Garante um bloco principal de pelo menos capacity bytes (so com a arena vazia)
+    void reserve(size_t capacity)
+    {
+        if (offset == 0 && overflow.empty()) grow(capacity);
+    }
+
+    size_t capacity() const { return size; }
+    size_t highWater() const { return high_water; }
+
+private:
+    void grow(size_t capacity)
+    {
+        if (capacity <= size) return;
+        block.reset(new char[capacity]);
+        size = capacity;
+    }
+
+    std::unique_ptr<char[]> block;
+    size_t size = 0;
+    size_t offset = 0;
+    size_t spilled = 0;
+    size_t high_water = 0;
+    std::vector<std::unique_ptr<char[]>> overflow;
+};
+
+//Arena da thread para os dados temporarios dos ticks de um unico processo
+//(somas por thread do tick paralelo, chaves da reordenacao das listas
+//ativas). Quem a usa chama reset ao terminar o tick.
+inline arena_t &tickArena()
+{
+    static thread_local arena_t arena;
+    return arena;
+}
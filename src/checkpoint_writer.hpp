@@ -0,0 +1,305 @@
+#pragma once
+
+#include "world_file.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Linhas de cada pedaco da grade copiado ou gravado de uma vez (multiplo do
+//ladrilho de Morton, para que cada pedaco seja um intervalo continuo)
+const uint32_t CHECKPOINT_CHUNK_ROWS = 64;
+static_assert(CHECKPOINT_CHUNK_ROWS % (1u << MORTON_TILE_BITS) == 0, "checkpoint chunks must hold whole Morton tiles");
+
+//Numeros dos checkpoints em segundo plano, para relatorio
+struct checkpoint_stats_t
+{
+    bool busy = false;
+    uint64_t written = 0;
+    uint64_t skipped = 0;
+    uint64_t failed = 0;
+    std::string last_path;
+    std::string last_error;
+    uint64_t last_tick = 0;
+    uint64_t last_bytes = 0;
+    double last_seconds = 0;
+    //Bytes da grade que o tick copiou antes de o escritor chegar a eles
+    uint64_t last_copied_bytes = 0;
+};
+
+//Checkpoints gravados por uma thread de E/S enquanto a simulacao segue. begin
+//nao copia a grade: o escritor le os pedacos direto do buffer do tick do
+//checkpoint. Nas regras de intencoes, esse buffer so e lido no tick seguinte e
+//volta a ser escrito no outro (ele vira next_grid); antes disso, beforeTick
+//copia para um buffer ao lado os pedacos que o escritor ainda nao gravou
+//(copia na escrita por pedaco), e o escritor grava esses da copia. As regras
+//originais escrevem no proprio buffer ja no tick seguinte, linha a linha:
+//beforeRow copia cada pedaco so quando a varredura vai escrever nele, entao o
+//escritor grava direto os pedacos a que chega antes dela. Cada pedaco tem um
+//estado atomico, entao um pedaco e gravado do buffer ou copiado, nunca os dois.
+//
+//Qualquer outra escrita na grade (reset, restauracao, montagem do quadro de um
+//motor particionado) ou troca do buffer deve chamar settle antes.
+class checkpoint_writer_t
+{
+public:
+    checkpoint_writer_t() = default;
+    ~checkpoint_writer_t()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (worker.joinable()) worker.join();
+    }
+
+    checkpoint_writer_t(const checkpoint_writer_t &) = delete;
+    checkpoint_writer_t &operator=(const checkpoint_writer_t &) = delete;
+
+    //Agenda um checkpoint do estado atual de w em path; false se o anterior
+    //ainda esta sendo gravado (este e pulado)
+    bool begin(const std::string &path, const world_t &w)
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        if (current.busy)
+        {
+            current.skipped++;
+            return false;
+        }
+        header = world_file::describe(w, 1);
+        rng = world_file::rngState(w);
+        header.rng_bytes = rng.size();
+        target = path;
+        source = w.entity_grid.data();
+        chunks = (w.rows + CHECKPOINT_CHUNK_ROWS - 1) / CHECKPOINT_CHUNK_ROWS;
+        if (chunks > chunk_capacity)
+        {
+            state.reset(new std::atomic<uint8_t>[chunks]);
+            chunk_capacity = chunks;
+        }
+        bounds.resize(chunks + 1);
+        for (uint32_t k = 0; k < chunks; k++)
+        {
+            state[k].store(pending, std::memory_order_relaxed);
+            bounds[k] = w.rowStart(k * CHECKPOINT_CHUNK_ROWS);
+        }
+        bounds[chunks] = w.entity_grid.size();
+        if (copy.size() < w.entity_grid.size()) copy = grid_vector_t<cell_t>(w.entity_grid.size());
+        outstanding.store(chunks, std::memory_order_release);
+        copied_bytes = 0;
+        current.busy = true;
+        queued = true;
+        lock.unlock();
+        wake.notify_all();
+        if (!worker.joinable()) worker = std::thread([this] { loop(); });
+        return true;
+    }
+
+    //Chamar antes de cada tick de w: se este tick vai escrever no buffer do
+    //checkpoint em andamento, copia os pedacos ainda nao gravados
+    void beforeTick(const world_t &w)
+    {
+        if (outstanding.load(std::memory_order_acquire) && w.next_grid.data() == source) settle();
+    }
+
+    //Chamar antes de as regras originais escreverem ate a linha row de w (a
+    //varredura avanca linha a linha): se o buffer e o do checkpoint em
+    //andamento, copia o pedaco dessa linha, caso o escritor ainda nao o tenha
+    //gravado. Os pedacos anteriores ja foram liberados nas linhas anteriores.
+    void beforeRow(const world_t &w, uint32_t row)
+    {
+        if (outstanding.load(std::memory_order_acquire) && w.entity_grid.data() == source)
+            settleChunk(std::min(row / CHECKPOINT_CHUNK_ROWS, chunks - 1));
+    }
+
+    //Libera o buffer do checkpoint em andamento: copia os pedacos que faltam
+    void settle()
+    {
+        if (!outstanding.load(std::memory_order_acquire)) return;
+        for (uint32_t k = 0; k < chunks; k++) settleChunk(k);
+    }
+
+    //Segura (on) ou solta o escritor antes do primeiro pedaco da grade: com ele
+    //segurado, os ticks tem que copiar todos os pedacos (usado pelo autoteste)
+    void hold(bool on)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            holding = on;
+        }
+        wake.notify_all();
+    }
+
+    //Espera o checkpoint em andamento terminar
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        idle.wait(lock, [this] { return !current.busy; });
+    }
+
+    checkpoint_stats_t stats() const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return current;
+    }
+
+private:
+    enum : uint8_t
+    {
+        pending,
+        writing,
+        copying,
+        copied,
+        done
+    };
+
+    //Copia o pedaco k se ele ainda depende do buffer, ou espera o escritor
+    //terminar de grava-lo
+    void settleChunk(uint32_t k)
+    {
+        uint8_t expected = pending;
+        if (state[k].compare_exchange_strong(expected, copying, std::memory_order_acq_rel))
+        {
+            std::memcpy(copy.data() + bounds[k], source + bounds[k], (bounds[k + 1] - bounds[k]) * sizeof(cell_t));
+            copied_bytes += (bounds[k + 1] - bounds[k]) * sizeof(cell_t);
+            state[k].store(copied, std::memory_order_release);
+            outstanding.fetch_sub(1, std::memory_order_acq_rel);
+        }
+        else
+        {
+            while (state[k].load(std::memory_order_acquire) == writing) std::this_thread::yield();
+        }
+    }
+
+    void loop()
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        while (true)
+        {
+            wake.wait(lock, [this] { return stopping || queued; });
+            if (!queued) return;
+            queued = false;
+            lock.unlock();
+
+            auto start = std::chrono::steady_clock::now();
+            std::string error;
+            try
+            {
+                write();
+            }
+            catch (const std::exception &e)
+            {
+                error = e.what();
+                //O buffer nao pode ficar preso a um checkpoint que falhou
+                release();
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            lock.lock();
+            current.busy = false;
+            if (error.empty())
+            {
+                current.written++;
+                current.last_path = target;
+                current.last_tick = header.tick;
+                current.last_bytes = header.file_bytes;
+                current.last_seconds = seconds;
+                current.last_copied_bytes = copied_bytes;
+            }
+            else
+            {
+                current.failed++;
+                current.last_error = error;
+            }
+            idle.notify_all();
+        }
+    }
+
+    //Grava o checkpoint pedaco a pedaco, do buffer ou da copia
+    void write()
+    {
+        std::string partial = target + ".partial";
+        int fd = ::open(partial.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) throw world_file::error("create " + partial);
+        try
+        {
+            if (::ftruncate(fd, (off_t)header.file_bytes) != 0) throw world_file::error("resize " + partial);
+            world_file::writeAll(fd, &header, sizeof(header), 0, partial);
+            world_file::writeAll(fd, rng.data(), rng.size(), header.rng_offset, partial);
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                wake.wait(lock, [this] { return !holding || stopping; });
+            }
+            for (uint32_t k = 0; k < chunks; k++)
+            {
+                uint64_t bytes = (bounds[k + 1] - bounds[k]) * sizeof(cell_t), offset = header.offsets[0] + bounds[k] * sizeof(cell_t);
+                uint8_t expected = pending;
+                if (state[k].compare_exchange_strong(expected, writing, std::memory_order_acq_rel))
+                {
+                    world_file::writeAll(fd, source + bounds[k], bytes, offset, partial);
+                    state[k].store(done, std::memory_order_release);
+                    outstanding.fetch_sub(1, std::memory_order_acq_rel);
+                    continue;
+                }
+                while (state[k].load(std::memory_order_acquire) == copying) std::this_thread::yield();
+                world_file::writeAll(fd, copy.data() + bounds[k], bytes, offset, partial);
+            }
+            if (::fdatasync(fd) != 0) throw world_file::error("sync " + partial);
+        }
+        catch (...)
+        {
+            ::close(fd);
+            ::unlink(partial.c_str());
+            throw;
+        }
+        ::close(fd);
+        if (::rename(partial.c_str(), target.c_str()) != 0) throw world_file::error("rename " + partial);
+    }
+
+    //Marca como gravados os pedacos que ainda apontam para o buffer (inclusive
+    //o que estava sendo gravado quando a escrita falhou)
+    void release()
+    {
+        for (uint32_t k = 0; k < chunks; k++)
+        {
+            uint8_t expected = pending;
+            if (state[k].compare_exchange_strong(expected, done, std::memory_order_acq_rel) || expected == writing)
+            {
+                state[k].store(done, std::memory_order_release);
+                outstanding.fetch_sub(1, std::memory_order_acq_rel);
+            }
+        }
+    }
+
+    mutable std::mutex mtx;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::thread worker;
+    checkpoint_stats_t current;
+    bool queued = false;
+    bool stopping = false;
+    bool holding = false;
+
+    //Checkpoint em andamento (so mudam em begin, com o escritor parado)
+    world_file_header_t header{};
+    std::string rng;
+    std::string target;
+    const cell_t *source = nullptr;
+    uint32_t chunks = 0;
+    uint32_t chunk_capacity = 0;
+    std::unique_ptr<std::atomic<uint8_t>[]> state;
+    std::vector<size_t> bounds;
+    grid_vector_t<cell_t> copy;
+    //Pedacos que ainda dependem do buffer do tick
+    std::atomic<uint32_t> outstanding{0};
+    std::atomic<uint64_t> copied_bytes{0};
+};
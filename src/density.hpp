@@ -0,0 +1,137 @@
+#pragma once
+
+#include "ecosim.hpp"
+
+#include <algorithm>
+#include <vector>
+
+//Piramide de contagens por especie, como um mip-map da grade: o nivel k tem um
+//bloco para cada 2^k x 2^k celulas, e cada bloco soma os 2x2 blocos do nivel
+//de baixo. O nivel 0 e a propria grade. So os ladrilhos marcados como sujos no
+//mundo (alguma celula mudou de especie) sao recalculados, e a mudanca sobe
+//apenas pelos blocos que os contem.
+class density_pyramid_t
+{
+public:
+    //Numero de niveis, contando o nivel 0; o ultimo tem um unico bloco
+    uint32_t levels() const { return (uint32_t)level.size(); }
+    uint32_t rows(uint32_t k) const { return k == 0 ? cell_rows : level[k].rows; }
+    uint32_t cols(uint32_t k) const { return k == 0 ? cell_cols : level[k].cols; }
+
+    //Contagem do bloco (i, j) do nivel k >= 1
+    const population_t &at(uint32_t k, uint32_t i, uint32_t j) const { return level[k].counts[(size_t)i * level[k].cols + j]; }
+
+    //Contagem do bloco (i, j) do nivel k, lendo a grade no nivel 0
+    population_t count(const world_t &w, uint32_t k, uint32_t i, uint32_t j) const
+    {
+        return k == 0 ? cellCount(w.at(i, j)) : at(k, i, j);
+    }
+
+    //Recalcula os ladrilhos sujos de w e limpa as marcas
+    void update(world_t &w)
+    {
+        if (w.rows != cell_rows || w.cols != cell_cols)
+        {
+            build(w.rows, w.cols);
+            w.touchAll();
+        }
+
+        const uint32_t side = 1u << DIRTY_TILE_BITS, tileLevel = std::min(DIRTY_TILE_BITS, levels() - 1);
+        for (size_t t = 0; t < w.dirty.size(); t++)
+        {
+            if (!w.dirty[t]) continue;
+            w.dirty[t] = 0;
+            uint32_t i0 = (uint32_t)(t / w.dirty_cols) * side, j0 = (uint32_t)(t % w.dirty_cols) * side;
+            for (uint32_t k = 1; k <= tileLevel; k++)
+            {
+                refine(w, k, i0 >> k, std::min((i0 + side) >> k, level[k].rows), j0 >> k, std::min((j0 + side) >> k, level[k].cols));
+            }
+            if (tileLevel + 1 < levels()) level[tileLevel + 1].dirty[(size_t)(i0 >> (tileLevel + 1)) * level[tileLevel + 1].cols + (j0 >> (tileLevel + 1))] = 1;
+        }
+
+        //Acima do ladrilho, cada nivel so refaz os blocos com um filho alterado
+        for (uint32_t k = tileLevel + 1; k < levels(); k++)
+        {
+            level_t &l = level[k];
+            for (size_t b = 0; b < l.dirty.size(); b++)
+            {
+                if (!l.dirty[b]) continue;
+                l.dirty[b] = 0;
+                uint32_t i = (uint32_t)(b / l.cols), j = (uint32_t)(b % l.cols);
+                refine(w, k, i, i + 1, j, j + 1);
+                if (k + 1 < levels()) level[k + 1].dirty[(size_t)(i >> 1) * level[k + 1].cols + (j >> 1)] = 1;
+            }
+        }
+    }
+
+    //Mesmas contagens em todos os niveis?
+    bool sameCounts(const density_pyramid_t &o) const
+    {
+        if (levels() != o.levels()) return false;
+        for (uint32_t k = 1; k < levels(); k++)
+        {
+            if (!std::equal(level[k].counts.begin(), level[k].counts.end(), o.level[k].counts.begin())) return false;
+        }
+        return true;
+    }
+
+private:
+    struct level_t
+    {
+        uint32_t rows = 0;
+        uint32_t cols = 0;
+        std::vector<population_t> counts;
+        std::vector<uint8_t> dirty;
+    };
+
+    static population_t cellCount(cell_t c)
+    {
+        population_t pop;
+        entity_type_t type = cellType(c);
+        pop.plants = type == entity_type_t::plant;
+        pop.herbivores = type == entity_type_t::herbivore;
+        pop.carnivores = type == entity_type_t::carnivore;
+        return pop;
+    }
+
+    void build(uint32_t r, uint32_t c)
+    {
+        cell_rows = r;
+        cell_cols = c;
+        level.assign(1, level_t());
+        while (r > 1 || c > 1)
+        {
+            r = (r + 1) / 2;
+            c = (c + 1) / 2;
+            level_t l;
+            l.rows = r;
+            l.cols = c;
+            l.counts.assign((size_t)r * c, population_t());
+            l.dirty.assign((size_t)r * c, 0);
+            level.push_back(std::move(l));
+        }
+    }
+
+    //Refaz os blocos [i0, i1) x [j0, j1) do nivel k a partir do nivel k - 1
+    void refine(const world_t &w, uint32_t k, uint32_t i0, uint32_t i1, uint32_t j0, uint32_t j1)
+    {
+        uint32_t below_rows = rows(k - 1), below_cols = cols(k - 1);
+        level_t &l = level[k];
+        for (uint32_t i = i0; i < i1; i++)
+        {
+            for (uint32_t j = j0; j < j1; j++)
+            {
+                population_t sum;
+                for (uint32_t a = 2 * i; a < std::min(2 * i + 2, below_rows); a++)
+                {
+                    for (uint32_t b = 2 * j; b < std::min(2 * j + 2, below_cols); b++) sum += count(w, k - 1, a, b);
+                }
+                l.counts[(size_t)i * l.cols + j] = sum;
+            }
+        }
+    }
+
+    uint32_t cell_rows = 0;
+    uint32_t cell_cols = 0;
+    std::vector<level_t> level;
+};
@@ -0,0 +1,431 @@
+#pragma once
+
+#include "active.hpp"
+#include "checkpoint_writer.hpp"
+#include "density.hpp"
+#include "ecosim.hpp"
+#include "mapped_world.hpp"
+#include "parallel.hpp"
+#include "tiled.hpp"
+#include "world_file.hpp"
+#include "tracking.hpp"
+#include "trajectory.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+//Cenario fixo da verificacao de determinismo e o hash esperado ao final dele.
+//Qualquer mudanca nas regras, no gerador ou na semeadura altera o hash; se a
+//mudanca for intencional, atualize DETERMINISM_HASH (regras de intencoes) ou
+//ORIGINAL_HASH (regras originais) com o valor impresso.
+struct determinism_case_t
+{
+    uint32_t rows = 96;
+    uint32_t cols = 80;
+    uint64_t seed = 2024;
+    uint32_t plants = 1500;
+    uint32_t herbivores = 300;
+    uint32_t carnivores = 60;
+    uint32_t ticks = 150;
+};
+
+const uint64_t DETERMINISM_HASH = 0x7a4c6c52b2905e7dULL;
+const uint64_t ORIGINAL_HASH = 0xffdfa5f68b0bea48ULL;
+
+namespace determinism
+{
+    inline world_t initialWorld(const determinism_case_t &c)
+    {
+        world_t w(c.rows, c.cols);
+        w.reset(c.seed);
+        startEcoSim(w, c.plants, c.herbivores, c.carnivores);
+        return w;
+    }
+
+    inline bool report(std::ostream &out, const std::string &name, uint64_t hash, uint64_t expected)
+    {
+        char text[17];
+        std::snprintf(text, sizeof text, "%016llx", (unsigned long long)hash);
+        out << name << ": " << text << (hash == expected ? " ok" : " MISMATCH") << "\n";
+        return hash == expected;
+    }
+
+    //Os contadores incrementais batem com uma recontagem da grade?
+    inline bool conserved(const population_t &counted, const world_t &w)
+    {
+        return counted == countPopulation(w);
+    }
+
+    //A piramide mantida pelos ladrilhos sujos e igual a uma montada do zero?
+    inline bool densityMatches(const density_pyramid_t &incremental, const world_t &w)
+    {
+        world_t copy = w;
+        density_pyramid_t fresh;
+        fresh.update(copy);
+        return incremental.sameCounts(fresh) && incremental.at(incremental.levels() - 1, 0, 0) == countPopulation(w);
+    }
+}
+
+//Roda o cenario no caminho sequencial, no tick paralelo com varios numeros de
+//threads e nos motores particionados, e compara todos os hashes com o esperado
+inline bool checkDeterminism(std::ostream &out, const determinism_case_t &c = determinism_case_t())
+{
+    bool ok = true;
+    bool counters = true;
+
+    //A piramide de densidade e atualizada a cada tick pelos ladrilhos sujos
+    world_t serial = determinism::initialWorld(c);
+    density_pyramid_t serialDensity;
+    for (uint32_t t = 0; t < c.ticks; t++)
+    {
+        nextIteration(serial);
+        serialDensity.update(serial);
+    }
+    ok &= determinism::report(out, "serial", gridHash(serial), DETERMINISM_HASH);
+    counters &= determinism::conserved(serial.population, serial);
+    counters &= determinism::densityMatches(serialDensity, serial);
+
+    for (unsigned threads : {1u, 2u, 3u, 8u, 64u})
+    {
+        thread_pool_t pool(threads);
+        world_t w = determinism::initialWorld(c);
+        density_pyramid_t density;
+        for (uint32_t t = 0; t < c.ticks; t++)
+        {
+            nextIterationParallel(w, pool);
+            if (t % 7 == 0) density.update(w);
+        }
+        density.update(w);
+        counters &= determinism::densityMatches(density, w);
+        ok &= determinism::report(out, "parallel x" + std::to_string(threads), gridHash(w), DETERMINISM_HASH);
+        counters &= determinism::conserved(w.population, w);
+    }
+
+    //Pool pinned: faixas em blocos fixos por thread, grade realocada pelo pool
+    {
+        thread_pool_t pool(3, true);
+        world_t w = determinism::initialWorld(c);
+        placeWorld(w, pool);
+        for (uint32_t t = 0; t < c.ticks; t++) nextIterationParallel(w, pool);
+        ok &= determinism::report(out, "pinned x3", gridHash(w), DETERMINISM_HASH);
+        counters &= determinism::conserved(w.population, w);
+    }
+
+    //Grade em ladrilhos de Morton
+    {
+        thread_pool_t pool(3);
+        world_t w;
+        w.layout = layout_morton;
+        w.resize(c.rows, c.cols);
+        w.reset(c.seed);
+        startEcoSim(w, c.plants, c.herbivores, c.carnivores);
+        for (uint32_t t = 0; t < c.ticks; t++) nextIterationParallel(w, pool);
+        ok &= determinism::report(out, "morton x3", gridHash(w), DETERMINISM_HASH);
+        counters &= determinism::conserved(w.population, w);
+    }
+
+    //Tick em frente de onda, em Morton, na memoria
+    {
+        world_t w;
+        w.layout = layout_morton;
+        w.resize(c.rows, c.cols);
+        w.reset(c.seed);
+        startEcoSim(w, c.plants, c.herbivores, c.carnivores);
+        for (uint32_t t = 0; t < c.ticks; t++) nextIterationWavefront(w);
+        ok &= determinism::report(out, "wavefront", gridHash(w), DETERMINISM_HASH);
+        counters &= determinism::conserved(w.population, w);
+    }
+
+    //Grade em arquivo mapeado, despejando faixas a cada tick; na metade o
+    //arquivo e fechado e reaberto em um mundo novo
+    {
+        std::string path = "/tmp/ecosim-determinism-" + std::to_string(::getpid()) + ".world";
+        world_t w = determinism::initialWorld(c);
+        {
+            mapped_world_t store;
+            store.create(path, w);
+            store.setResidentBudget(1);
+            for (uint32_t t = 0; t < c.ticks / 2; t++) nextIterationWavefront(w, &store);
+        }
+        world_t reopened;
+        mapped_world_t store;
+        store.open(path, reopened);
+        ::unlink(path.c_str());
+        store.setResidentBudget(1);
+        for (uint32_t t = c.ticks / 2; t < c.ticks; t++) nextIterationWavefront(reopened, &store);
+        ok &= determinism::report(out, "world file", gridHash(reopened), DETERMINISM_HASH);
+        counters &= determinism::conserved(reopened.population, reopened);
+    }
+
+    //Regras originais, nos dois layouts; em Morton com um checkpoint na metade,
+    //que leva o estado do gerador
+    for (grid_layout_t layout : {layout_row_major, layout_morton})
+    {
+        std::string path = "/tmp/ecosim-determinism-" + std::to_string(::getpid()) + ".original";
+        world_t w;
+        w.layout = layout;
+        w.resize(c.rows, c.cols);
+        w.reset(c.seed);
+        startEcoSim(w, c.plants, c.herbivores, c.carnivores);
+        density_pyramid_t density;
+        for (uint32_t t = 0; t < c.ticks; t++)
+        {
+            if (layout == layout_morton && t == c.ticks / 2)
+            {
+                world_file::save(path, w);
+                w = world_t();
+                world_file::load(path, w);
+                ::unlink(path.c_str());
+            }
+            nextIterationOriginal(w);
+            density.update(w);
+        }
+        counters &= determinism::conserved(w.population, w);
+        counters &= determinism::densityMatches(density, w);
+        ok &= determinism::report(out, layout == layout_morton ? "original rules, morton, checkpoint" : "original rules", gridHash(w), ORIGINAL_HASH);
+    }
+
+    //Checkpoint na metade, restaurado em um mundo de outro tamanho e layout
+    {
+        std::string path = "/tmp/ecosim-determinism-" + std::to_string(::getpid()) + ".ckpt";
+        world_t w = determinism::initialWorld(c);
+        for (uint32_t t = 0; t < c.ticks / 2; t++) nextIteration(w);
+        world_file::save(path, w);
+        world_t restored;
+        restored.layout = layout_morton;
+        restored.resize(7, 9);
+        world_file::load(path, restored);
+        ok &= restored.gen == w.gen && restored.layout == layout_row_major;
+
+        //Um arquivo com o gerador corrompido falha sem mexer no mundo, com ou
+        //sem troca de dimensoes
+        {
+            world_file_header_t h = world_file::readHeader(path);
+            std::string garbage(h.rng_bytes, 'x');
+            int fd = ::open(path.c_str(), O_WRONLY);
+            ok &= fd >= 0 && ::pwrite(fd, garbage.data(), garbage.size(), (off_t)h.rng_offset) == (ssize_t)garbage.size();
+            if (fd >= 0) ::close(fd);
+        }
+        world_t other;
+        other.resize(5, 5);
+        bool intact = true;
+        for (world_t *target : {&restored, &other})
+        {
+            uint64_t before = gridHash(*target), tick = target->tick;
+            uint32_t rows = target->rows;
+            bool failed = false;
+            try
+            {
+                world_file::load(path, *target);
+            }
+            catch (const std::exception &)
+            {
+                failed = true;
+            }
+            intact &= failed && gridHash(*target) == before && target->tick == tick && target->rows == rows;
+        }
+        out << "corrupt checkpoint leaves the world intact:" << (intact ? " ok" : " MISMATCH") << "\n";
+        ok &= intact;
+        ::unlink(path.c_str());
+        for (uint32_t t = c.ticks / 2; t < c.ticks; t++) nextIteration(restored);
+        ok &= determinism::report(out, "checkpoint", gridHash(restored), DETERMINISM_HASH);
+        counters &= determinism::conserved(restored.population, restored);
+    }
+
+    //Checkpoint em segundo plano enquanto os ticks seguem, conferido ao final:
+    //com o escritor livre (pedacos copiados pelo tick ou gravados direto do
+    //buffer) e segurado ate o fim (todos copiados pelos ticks), no tick denso,
+    //no tick esparso e nas regras originais (que escrevem no proprio buffer)
+    struct background_case_t
+    {
+        const char *name;
+        bool held, lists, original;
+    };
+    for (background_case_t b : {background_case_t{"background checkpoint", false, false, false},
+                                background_case_t{"held background checkpoint", true, false, false},
+                                background_case_t{"active lists background checkpoint", true, true, false},
+                                background_case_t{"original rules background checkpoint", false, false, true},
+                                background_case_t{"original rules held background checkpoint", true, false, true}})
+    {
+        std::string path = "/tmp/ecosim-determinism-" + std::to_string(::getpid()) + ".async";
+        world_t w = determinism::initialWorld(c);
+        checkpoint_writer_t writer;
+        active_ticker_t lists(7);
+        writer.hold(b.held);
+        uint64_t expected = 0;
+        for (uint32_t t = 0; t < c.ticks; t++)
+        {
+            writer.beforeTick(w);
+            if (b.original)
+                nextIterationOriginal(w, [&](uint32_t row) { writer.beforeRow(w, row); });
+            else if (b.lists)
+                lists.step(w);
+            else
+                nextIteration(w);
+            if (w.tick != c.ticks / 3) continue;
+            expected = gridHash(w);
+            writer.begin(path, w);
+        }
+        writer.hold(false);
+        writer.wait();
+        world_t restored;
+        world_file::load(path, restored);
+        ::unlink(path.c_str());
+        ok &= writer.stats().written == 1 && gridHash(restored) == expected && restored.tick == c.ticks / 3;
+        counters &= determinism::conserved(restored.population, restored);
+        for (uint32_t t = c.ticks / 3; t < c.ticks; t++)
+        {
+            if (b.original)
+                nextIterationOriginal(restored);
+            else
+                nextIteration(restored);
+        }
+        ok &= determinism::report(out, b.name, gridHash(restored), b.original ? ORIGINAL_HASH : DETERMINISM_HASH);
+    }
+
+    //Trajetoria gravada em Morton (sem e com compressao) e relida por busca:
+    //cada tick pedido, em qualquer ordem, tem que reproduzir o hash e a
+    //populacao da simulacao
+    for (bool packed : {false, true})
+    {
+        std::string path = "/tmp/ecosim-determinism-" + std::to_string(::getpid()) + ".traj";
+        world_t w;
+        w.layout = layout_morton;
+        w.resize(c.rows, c.cols);
+        w.reset(c.seed);
+        startEcoSim(w, c.plants, c.herbivores, c.carnivores);
+        std::vector<uint64_t> hashes(1, gridHash(w));
+        std::vector<population_t> populations(1, w.population);
+        {
+            trajectory_recorder_t recorder;
+            recorder.start(path, w, 32, packed);
+            for (uint32_t t = 0; t < c.ticks; t++)
+            {
+                nextIteration(w);
+                recorder.push(w);
+                hashes.push_back(gridHash(w));
+                populations.push_back(w.population);
+            }
+            recorder.finish();
+        }
+        trajectory_reader_t reader;
+        reader.open(path);
+        world_t replay;
+        bool seeks = reader.firstTick() == 0 && reader.lastTick() == c.ticks;
+        for (uint64_t tick : {0ull, 1ull, 31ull, 32ull, 33ull, 100ull, 10ull, 60ull, 61ull, 62ull, 95ull, 96ull, (unsigned long long)c.ticks})
+        {
+            reader.seek(tick, replay);
+            seeks &= gridHash(replay) == hashes[tick] && replay.population == populations[tick] && replay.tick == tick;
+        }
+        ::unlink(path.c_str());
+        ::unlink((path + ".idx").c_str());
+        ok &= seeks;
+        ok &= determinism::report(out, std::string(packed ? "packed trajectory" : "trajectory") + (seeks ? "" : " (seek MISMATCH)"), gridHash(replay),
+                                  DETERMINISM_HASH);
+    }
+
+    //Tick esparso sobre listas de seres vivos, com identidades
+    {
+        world_t w = determinism::initialWorld(c);
+        active_ticker_t lists(7);
+        entity_tracker_t tracker;
+        tracker.attach(w);
+        density_pyramid_t density;
+        for (uint32_t t = 0; t < c.ticks; t++)
+        {
+            lists.step(w, &tracker);
+            density.update(w);
+        }
+        counters &= determinism::densityMatches(density, w);
+        ok &= determinism::report(out, "active lists", gridHash(w), DETERMINISM_HASH);
+        ok &= tracker.tracked() == lists.live();
+        counters &= determinism::conserved(w.population, w);
+    }
+
+    //Com o rastreador de identidades: mesmo estado, e cada ser vivo com um
+    //handle valido e unico
+    {
+        thread_pool_t pool(3);
+        world_t w = determinism::initialWorld(c);
+        entity_tracker_t tracker;
+        tracker.attach(w);
+        for (uint32_t t = 0; t < c.ticks; t++)
+        {
+            if (t % 2)
+                nextIterationTracked(w, tracker);
+            else
+                nextIterationParallel(w, pool, &tracker);
+        }
+        ok &= determinism::report(out, "tracked", gridHash(w), DETERMINISM_HASH);
+        counters &= determinism::conserved(w.population, w);
+
+        population_t pop = countPopulation(w);
+        std::vector<uint32_t> seen;
+        bool valid = tracker.tracked() == (size_t)pop.plants + pop.herbivores + pop.carnivores;
+        for (uint32_t i = 0; i < w.rows; i++)
+        {
+            for (uint32_t j = 0; j < w.cols; j++)
+            {
+                handle_t h = tracker.handleAt(w, i, j);
+                bool live = cellType(w.at(i, j)) != entity_type_t::empty;
+                valid &= live == (tracker.record(h) != nullptr);
+                if (live) seen.push_back(h.bits);
+            }
+        }
+        std::sort(seen.begin(), seen.end());
+        valid &= std::adjacent_find(seen.begin(), seen.end()) == seen.end();
+        out << "tracked handles: " << tracker.tracked() << (valid ? " ok" : " INCONSISTENT") << "\n";
+        ok &= valid;
+    }
+
+    //O ultimo caso rebalanceia sempre que a carga medida nao e exatamente igual
+    struct tiled_case_t
+    {
+        uint32_t pr, pc, halo;
+        unsigned threads;
+        bool pinned;
+        uint32_t rebalance;
+    };
+    for (tiled_case_t t : {tiled_case_t{2, 2, 1, 4, false, 0}, tiled_case_t{3, 5, 2, 2, true, 0}, tiled_case_t{1, 8, 3, 8, false, 0},
+                           tiled_case_t{2, 3, 2, 3, false, 10}})
+    {
+        world_t w = determinism::initialWorld(c);
+        tiled_engine_t engine(partitionGrid(c.rows, c.cols, t.pr, t.pc), t.halo, t.threads, t.pinned);
+        if (t.rebalance) engine.enableRebalance(t.rebalance, 1.0);
+        engine.load(w);
+        //Em metade das paradas so as especies vem dos subdominios (como em
+        //GET /density); elas devem bater com as do quadro completo
+        density_pyramid_t density;
+        for (uint32_t done = 0; done < c.ticks; done += 50)
+        {
+            engine.step(std::min(50u, c.ticks - done));
+            if (done % 100 == 0 && done + 50 < c.ticks)
+            {
+                engine.gatherSpecies(w);
+                world_t full = w;
+                engine.gather(full);
+                for (uint32_t i = 0; i < w.rows; i++)
+                {
+                    for (uint32_t j = 0; j < w.cols; j++) counters &= cellType(w.at(i, j)) == cellType(full.at(i, j));
+                }
+            }
+            else
+                engine.gather(w);
+            density.update(w);
+            counters &= determinism::densityMatches(density, w);
+        }
+        counters &= determinism::conserved(engine.population(), w);
+        counters &= determinism::densityMatches(density, w);
+        ok &= determinism::report(out, "tiled " + std::to_string(t.pr) + "x" + std::to_string(t.pc) + " halo " +
+                                           std::to_string(t.halo) + " x" + std::to_string(t.threads) + (t.pinned ? " pinned" : "") +
+                                           (t.rebalance ? " rebalanced" : ""),
+                                  gridHash(w), DETERMINISM_HASH);
+    }
+
+    out << "population counters and density pyramid:" << (counters ? " ok" : " MISMATCH") << "\n";
+    return ok && counters;
+}
@@ -0,0 +1,662 @@
+#pragma once
+
+#include "arena.hpp"
+#include "subdomain.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace net
+{
+    inline std::runtime_error error(const std::string &what)
+    {
+        return std::runtime_error(what + ": " + std::strerror(errno));
+    }
+
+    inline void sendAll(int fd, const void *data, size_t size)
+    {
+        const char *p = (const char *)data;
+        while (size > 0)
+        {
+            ssize_t n = ::send(fd, p, size, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw error("send");
+            p += n;
+            size -= n;
+        }
+    }
+
+    inline void recvAll(int fd, void *data, size_t size)
+    {
+        char *p = (char *)data;
+        while (size > 0)
+        {
+            ssize_t n = ::recv(fd, p, size, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n == 0) throw std::runtime_error("recv: connection closed");
+            if (n < 0) throw error("recv");
+            p += n;
+            size -= n;
+        }
+    }
+
+    //Enderecos no formato "unix:/caminho" ou "tcp:host:porta"
+    inline bool isUnix(const std::string &addr) { return addr.compare(0, 5, "unix:") == 0; }
+
+    inline sockaddr_un unixAddress(const std::string &addr)
+    {
+        sockaddr_un sa{};
+        sa.sun_family = AF_UNIX;
+        std::string path = addr.substr(5);
+        if (path.size() >= sizeof(sa.sun_path)) throw std::invalid_argument("unix socket path too long: " + path);
+        std::strcpy(sa.sun_path, path.c_str());
+        return sa;
+    }
+
+    inline void splitTcp(const std::string &addr, std::string &host, std::string &port)
+    {
+        if (addr.compare(0, 4, "tcp:") != 0) throw std::invalid_argument("expected unix:PATH or tcp:HOST:PORT, got " + addr);
+        size_t colon = addr.rfind(':');
+        host = addr.substr(4, colon - 4);
+        port = addr.substr(colon + 1);
+    }
+
+    inline void tuneTcp(int fd)
+    {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    //Abre um socket de escuta e devolve em bound o endereco real (porta 0 = qualquer)
+    inline int listenOn(const std::string &addr, std::string &bound)
+    {
+        int fd;
+        if (isUnix(addr))
+        {
+            sockaddr_un sa = unixAddress(addr);
+            ::unlink(sa.sun_path);
+            fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0 || ::bind(fd, (sockaddr *)&sa, sizeof(sa)) < 0) throw error("bind " + addr);
+            bound = addr;
+        }
+        else
+        {
+            std::string host, port;
+            splitTcp(addr, host, port);
+            sockaddr_in sa{};
+            sa.sin_family = AF_INET;
+            sa.sin_port = htons((uint16_t)std::stoi(port));
+            sa.sin_addr.s_addr = host.empty() || host == "*" ? htonl(INADDR_ANY) : inet_addr(host.c_str());
+            fd = ::socket(AF_INET, SOCK_STREAM, 0);
+            int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            if (fd < 0 || ::bind(fd, (sockaddr *)&sa, sizeof(sa)) < 0) throw error("bind " + addr);
+            socklen_t len = sizeof(sa);
+            getsockname(fd, (sockaddr *)&sa, &len);
+            bool any = host.empty() || host == "*";
+            bound = "tcp:" + (any ? std::string("127.0.0.1") : host) + ":" + std::to_string(ntohs(sa.sin_port));
+        }
+        if (::listen(fd, 64) < 0) throw error("listen " + addr);
+        return fd;
+    }
+
+    inline int acceptFrom(int listener)
+    {
+        int fd;
+        do fd = ::accept(listener, nullptr, nullptr);
+        while (fd < 0 && errno == EINTR);
+        if (fd < 0) throw error("accept");
+        return fd;
+    }
+
+    inline int connectTo(const std::string &addr)
+    {
+        if (isUnix(addr))
+        {
+            sockaddr_un sa = unixAddress(addr);
+            int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0 || ::connect(fd, (sockaddr *)&sa, sizeof(sa)) < 0) throw error("connect " + addr);
+            return fd;
+        }
+
+        std::string host, port;
+        splitTcp(addr, host, port);
+        addrinfo hints{}, *res = nullptr;
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0) throw std::runtime_error("cannot resolve " + addr);
+        int fd = ::socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        int rc = fd < 0 ? -1 : ::connect(fd, res->ai_addr, res->ai_addrlen);
+        freeaddrinfo(res);
+        if (rc < 0) throw error("connect " + addr);
+        tuneTcp(fd);
+        return fd;
+    }
+
+    //IP local usado por uma conexao TCP, para anunciar o endereco de escuta aos vizinhos
+    inline std::string localHost(int fd)
+    {
+        sockaddr_in sa{};
+        socklen_t len = sizeof(sa);
+        getsockname(fd, (sockaddr *)&sa, &len);
+        char text[INET_ADDRSTRLEN] = "127.0.0.1";
+        inet_ntop(AF_INET, &sa.sin_addr, text, sizeof(text));
+        return text;
+    }
+
+    //Envia e recebe com todos os vizinhos ao mesmo tempo, sem risco de deadlock
+    //quando os dois lados enviam mensagens maiores que o buffer do socket
+    struct transfer_t
+    {
+        int fd;
+        const char *out;
+        size_t outSize;
+        char *in;
+        size_t inSize;
+    };
+
+    inline void exchange(transfer_t *transfers, size_t count, arena_t &scratch)
+    {
+        pollfd *fds = scratch.make<pollfd>(count);
+        while (true)
+        {
+            size_t active = 0;
+            for (size_t k = 0; k < count; k++)
+            {
+                const transfer_t &t = transfers[k];
+                fds[k] = {t.fd, (short)((t.outSize ? POLLOUT : 0) | (t.inSize ? POLLIN : 0)), 0};
+                active += t.outSize || t.inSize;
+            }
+            if (active == 0) return;
+            if (::poll(fds, count, -1) < 0)
+            {
+                if (errno == EINTR) continue;
+                throw error("poll");
+            }
+
+            for (size_t k = 0; k < count; k++)
+            {
+                transfer_t &t = transfers[k];
+                if ((fds[k].revents & POLLOUT) && t.outSize)
+                {
+                    ssize_t n = ::send(t.fd, t.out, t.outSize, MSG_NOSIGNAL | MSG_DONTWAIT);
+                    if (n < 0 && errno != EAGAIN && errno != EINTR) throw error("send halo");
+                    if (n > 0) t.out += n, t.outSize -= n;
+                }
+                if ((fds[k].revents & (POLLIN | POLLHUP | POLLERR)) && t.inSize)
+                {
+                    ssize_t n = ::recv(t.fd, t.in, t.inSize, MSG_DONTWAIT);
+                    if (n == 0) throw std::runtime_error("halo peer closed the connection");
+                    if (n < 0 && errno != EAGAIN && errno != EINTR) throw error("recv halo");
+                    if (n > 0) t.in += n, t.inSize -= n;
+                }
+            }
+        }
+    }
+}
+
+namespace distributed
+{
+    const size_t ADDRESS_SIZE = 108;
+
+    enum message_type_t : uint32_t
+    {
+        msg_hello,
+        msg_setup,
+        msg_load,
+        msg_step,
+        msg_done,
+        msg_frame,
+        msg_species,
+        msg_quit
+    };
+
+    struct message_t
+    {
+        uint32_t type;
+        uint32_t count;
+        uint64_t value;
+    };
+
+    //Configuracao enviada pelo coordenador a cada processo; seguida de
+    //workers retangulos (rect_t) e workers enderecos de escuta
+    struct setup_t
+    {
+        uint32_t rank;
+        uint32_t workers;
+        uint32_t world_rows;
+        uint32_t world_cols;
+        uint32_t exchange_ticks;
+        species_params_t params;
+    };
+
+    //Estado inicial de um subdominio; seguido das celulas do retangulo estendido.
+    //Os parametros vao de novo a cada carga: um checkpoint restaurado pode
+    //trazer outros.
+    struct load_t
+    {
+        uint64_t seed;
+        uint64_t tick;
+        species_params_t params;
+    };
+
+    inline void sendMessage(int fd, message_type_t type, uint32_t count = 0, uint64_t value = 0)
+    {
+        message_t m{type, count, value};
+        net::sendAll(fd, &m, sizeof(m));
+    }
+
+    inline message_t recvMessage(int fd)
+    {
+        message_t m;
+        net::recvAll(fd, &m, sizeof(m));
+        return m;
+    }
+
+    inline message_t expect(int fd, message_type_t type)
+    {
+        message_t m = recvMessage(fd);
+        if (m.type != type) throw std::runtime_error("unexpected message " + std::to_string(m.type) + ", wanted " + std::to_string(type));
+        return m;
+    }
+
+    //Conexao com um subdominio vizinho e os retangulos trocados a cada tick
+    struct peer_t
+    {
+        uint32_t rank;
+        int fd;
+        rect_t send;
+        rect_t recv;
+        std::vector<cell_t> out;
+        std::vector<cell_t> in;
+    };
+
+    //Processo de trabalho: simula um subdominio e troca o halo com os vizinhos
+    class worker_t
+    {
+    public:
+        explicit worker_t(const std::string &coordinator)
+        {
+            control = net::connectTo(coordinator);
+
+            std::string want = net::isUnix(coordinator) ? "unix:/tmp/ecosim-worker-" + std::to_string(::getpid()) + ".sock"
+                                                        : "tcp:" + net::localHost(control) + ":0";
+            listener = net::listenOn(want, address);
+
+            char hello[ADDRESS_SIZE] = {};
+            std::strncpy(hello, address.c_str(), ADDRESS_SIZE - 1);
+            sendMessage(control, msg_hello);
+            net::sendAll(control, hello, sizeof(hello));
+        }
+
+        ~worker_t()
+        {
+            for (peer_t &p : peers) ::close(p.fd);
+            if (listener >= 0) ::close(listener);
+            if (control >= 0) ::close(control);
+            if (net::isUnix(address)) ::unlink(address.c_str() + 5);
+        }
+
+        void run()
+        {
+            while (true)
+            {
+                message_t m = recvMessage(control);
+                if (m.type == msg_setup) setup();
+                else if (m.type == msg_load) load();
+                else if (m.type == msg_step) step(m.count);
+                else if (m.type == msg_frame) frame();
+                else if (m.type == msg_species) species();
+                else if (m.type == msg_quit) return;
+                else throw std::runtime_error("unknown message " + std::to_string(m.type));
+            }
+        }
+
+    private:
+        void setup()
+        {
+            setup_t s;
+            net::recvAll(control, &s, sizeof(s));
+            std::vector<rect_t> layout(s.workers);
+            std::vector<char> addresses(s.workers * ADDRESS_SIZE);
+            net::recvAll(control, layout.data(), layout.size() * sizeof(rect_t));
+            net::recvAll(control, addresses.data(), addresses.size());
+
+            sub.setup(s.rank, layout[s.rank], s.exchange_ticks, s.world_rows, s.world_cols);
+            sub.local.params = s.params;
+
+            //Vizinhos: quem tem celulas no meu halo ou precisa das minhas no halo dele.
+            //O processo de rank maior conecta no de rank menor.
+            size_t accepts = 0;
+            for (const halo_link_t &link : haloLinks(layout, s.rank, s.exchange_ticks, s.world_rows, s.world_cols))
+            {
+                peer_t p{link.rank, -1, link.send, link.recv, {}, {}};
+                p.out.resize(p.send.area());
+                p.in.resize(p.recv.area());
+                if (p.rank < s.rank)
+                {
+                    p.fd = net::connectTo(std::string(&addresses[p.rank * ADDRESS_SIZE]));
+                    net::sendAll(p.fd, &s.rank, sizeof(s.rank));
+                }
+                else
+                {
+                    accepts++;
+                }
+                peers.push_back(std::move(p));
+            }
+            for (; accepts > 0; accepts--)
+            {
+                int fd = net::acceptFrom(listener);
+                uint32_t q;
+                net::recvAll(fd, &q, sizeof(q));
+                for (peer_t &p : peers)
+                {
+                    if (p.rank == q) p.fd = fd;
+                }
+            }
+            for (peer_t &p : peers)
+            {
+                if (!net::isUnix(address)) net::tuneTcp(p.fd);
+            }
+        }
+
+        void load()
+        {
+            load_t l;
+            net::recvAll(control, &l, sizeof(l));
+            net::recvAll(control, sub.local.entity_grid.data(), sub.local.entity_grid.size() * sizeof(cell_t));
+            sub.local.seed = l.seed;
+            sub.local.tick = l.tick;
+            sub.local.params = l.params;
+            sub.since_exchange = 0;
+            sub.countOwned();
+        }
+
+        //O halo so e trocado quando a parte valida dele acabou, a cada exchange_ticks ticks.
+        //msg_done vem seguida da populacao das celulas proprias e dos eventos do
+        //ultimo tick delas
+        void step(uint32_t ticks)
+        {
+            uint32_t exchanges = 0;
+            for (uint32_t t = 0; t < ticks; t++)
+            {
+                if (sub.haloStale())
+                {
+                    exchangeHalo();
+                    exchanges++;
+                }
+                sub.step();
+                scratch.reset();
+            }
+            sendMessage(control, msg_done, exchanges, sub.local.tick);
+            net::sendAll(control, &sub.local.population, sizeof(population_t));
+            net::sendAll(control, &sub.local.last_counts, sizeof(tick_counts_t));
+        }
+
+        void exchangeHalo()
+        {
+            net::transfer_t *transfers = scratch.make<net::transfer_t>(peers.size());
+            for (size_t k = 0; k < peers.size(); k++)
+            {
+                peer_t &p = peers[k];
+                packRect(sub.local, p.send, p.out.data());
+                transfers[k] = {p.fd, (const char *)p.out.data(), p.out.size() * sizeof(cell_t),
+                                (char *)p.in.data(), p.in.size() * sizeof(cell_t)};
+            }
+            net::exchange(transfers, peers.size(), scratch);
+            for (peer_t &p : peers) unpackRect(sub.local, p.recv, p.in.data());
+            sub.since_exchange = 0;
+        }
+
+        void frame()
+        {
+            cell_t *cells = scratch.make<cell_t>(sub.owned.area());
+            packRect(sub.local, sub.owned, cells);
+            net::sendAll(control, cells, sub.owned.area() * sizeof(cell_t));
+            scratch.reset();
+        }
+
+        //Ladrilhos em que alguma celula propria mudou de especie desde o ultimo
+        //pedido: o numero de retangulos, os retangulos e as celulas de cada um
+        void species()
+        {
+            rect_t *rects = scratch.make<rect_t>(sub.local.dirty.size());
+            uint32_t count = 0;
+            size_t area = 0;
+            takeDirty(sub.local, sub.owned, [&](const rect_t &r) {
+                rects[count++] = r;
+                area += r.area();
+            });
+            cell_t *cells = scratch.make<cell_t>(area), *out = cells;
+            for (uint32_t k = 0; k < count; k++)
+            {
+                packRect(sub.local, rects[k], out);
+                out += rects[k].area();
+            }
+            net::sendAll(control, &count, sizeof(count));
+            net::sendAll(control, rects, count * sizeof(rect_t));
+            net::sendAll(control, cells, area * sizeof(cell_t));
+            scratch.reset();
+        }
+
+        int control = -1;
+        int listener = -1;
+        std::string address;
+        subdomain_t sub;
+        std::vector<peer_t> peers;
+
+        //Memoria temporaria do tick (trocas de halo) e dos quadros
+        arena_t scratch;
+    };
+
+    inline int workerMain(const std::string &coordinator)
+    {
+        worker_t worker(coordinator);
+        worker.run();
+        return 0;
+    }
+}
+
+//Coordenador: distribui o mundo entre os processos, comanda os ticks e monta
+//os quadros completos a partir das celulas proprias de cada subdominio
+class cluster_t : public partitioned_engine_t
+{
+public:
+    //Escuta em listenAddr; com spawn, cria os processos de trabalho localmente (fork).
+    //O halo tem largura para exchangeTicks ticks entre duas trocas.
+    cluster_t(const std::string &listenAddr, const std::vector<rect_t> &parts, bool spawn, uint32_t exchangeTicks = 1)
+        : layout(parts), exchange_ticks(exchangeTicks)
+    {
+        listener = net::listenOn(listenAddr, address);
+        if (spawn)
+        {
+            for (size_t k = 0; k < layout.size(); k++)
+            {
+                pid_t pid = ::fork();
+                if (pid < 0) throw net::error("fork");
+                if (pid == 0)
+                {
+                    int code = 1;
+                    try
+                    {
+                        ::close(listener);
+                        code = distributed::workerMain(address);
+                    }
+                    catch (const std::exception &e)
+                    {
+                        std::fprintf(stderr, "worker %d: %s\n", (int)::getpid(), e.what());
+                    }
+                    ::_exit(code);
+                }
+                children.push_back(pid);
+            }
+        }
+
+        addresses.assign(layout.size() * distributed::ADDRESS_SIZE, 0);
+        for (size_t k = 0; k < layout.size(); k++)
+        {
+            int fd = net::acceptFrom(listener);
+            if (!net::isUnix(address)) net::tuneTcp(fd);
+            distributed::expect(fd, distributed::msg_hello);
+            net::recvAll(fd, &addresses[k * distributed::ADDRESS_SIZE], distributed::ADDRESS_SIZE);
+            workers.push_back(fd);
+        }
+    }
+
+    ~cluster_t() override
+    {
+        for (int fd : workers)
+        {
+            try
+            {
+                distributed::sendMessage(fd, distributed::msg_quit);
+            }
+            catch (const std::exception &)
+            {
+            }
+            ::close(fd);
+        }
+        for (pid_t pid : children) ::waitpid(pid, nullptr, 0);
+        ::close(listener);
+        if (net::isUnix(address)) ::unlink(address.c_str() + 5);
+    }
+
+    cluster_t(const cluster_t &) = delete;
+    cluster_t &operator=(const cluster_t &) = delete;
+
+    const std::string &listenAddress() const { return address; }
+
+    uint64_t exchanges() const override { return exchange_rounds; }
+    population_t population() const override { return pop; }
+    tick_counts_t lastCounts() const override { return last_counts; }
+
+    //Envia a particao e o estado inicial (celulas proprias + halo) a cada processo
+    void load(const world_t &world) override
+    {
+        if (!configured)
+        {
+            for (uint32_t k = 0; k < workers.size(); k++)
+            {
+                distributed::setup_t s{k, (uint32_t)workers.size(), world.rows, world.cols, exchange_ticks, world.params};
+                distributed::sendMessage(workers[k], distributed::msg_setup);
+                net::sendAll(workers[k], &s, sizeof(s));
+                net::sendAll(workers[k], layout.data(), layout.size() * sizeof(rect_t));
+                net::sendAll(workers[k], addresses.data(), addresses.size());
+            }
+            configured = true;
+        }
+
+        tick = world.tick;
+        pop = world.population;
+        last_counts = tick_counts_t();
+        std::vector<cell_t> cells;
+        for (uint32_t k = 0; k < workers.size(); k++)
+        {
+            rect_t extended = expand(layout[k], haloWidth(exchange_ticks), world.rows, world.cols);
+            cells.resize(extended.area());
+            packRect(world, extended, cells.data());
+
+            distributed::load_t l{world.seed, world.tick, world.params};
+            distributed::sendMessage(workers[k], distributed::msg_load);
+            net::sendAll(workers[k], &l, sizeof(l));
+            net::sendAll(workers[k], cells.data(), cells.size() * sizeof(cell_t));
+        }
+    }
+
+    uint64_t step(uint32_t ticks) override
+    {
+        for (int fd : workers) distributed::sendMessage(fd, distributed::msg_step, ticks);
+        uint32_t rounds = 0;
+        pop = population_t();
+        last_counts = tick_counts_t();
+        for (int fd : workers)
+        {
+            distributed::message_t done = distributed::expect(fd, distributed::msg_done);
+            tick = done.value;
+            rounds = std::max(rounds, done.count);
+
+            population_t owned;
+            tick_counts_t counts;
+            net::recvAll(fd, &owned, sizeof(owned));
+            net::recvAll(fd, &counts, sizeof(counts));
+            pop += owned;
+            last_counts += counts;
+        }
+        exchange_rounds += rounds;
+        return tick;
+    }
+
+    //Os processos nao enviam as marcas de ladrilhos sujos: o quadro montado
+    //conta como todo alterado
+    void gather(world_t &world) override
+    {
+        for (int fd : workers) distributed::sendMessage(fd, distributed::msg_frame);
+
+        for (size_t k = 0; k < workers.size(); k++)
+        {
+            cell_t *cells = scratch.make<cell_t>(layout[k].area());
+            net::recvAll(workers[k], cells, layout[k].area() * sizeof(cell_t));
+            unpackRect(world, layout[k], cells);
+            scratch.reset();
+        }
+        world.tick = tick;
+        world.population = pop;
+        world.last_counts = last_counts;
+        world.touchAll();
+    }
+
+    void gatherSpecies(world_t &world) override
+    {
+        for (int fd : workers) distributed::sendMessage(fd, distributed::msg_species);
+
+        for (int fd : workers)
+        {
+            uint32_t count;
+            net::recvAll(fd, &count, sizeof(count));
+            rect_t *rects = scratch.make<rect_t>(count);
+            net::recvAll(fd, rects, count * sizeof(rect_t));
+            for (uint32_t k = 0; k < count; k++)
+            {
+                cell_t *cells = scratch.make<cell_t>(rects[k].area());
+                net::recvAll(fd, cells, rects[k].area() * sizeof(cell_t));
+                unpackRect(world, rects[k], cells);
+                touchRect(world, rects[k]);
+            }
+            scratch.reset();
+        }
+        world.tick = tick;
+        world.population = pop;
+        world.last_counts = last_counts;
+    }
+
+private:
+    std::vector<rect_t> layout;
+    std::string address;
+    int listener = -1;
+    std::vector<int> workers;
+    std::vector<char> addresses;
+    std::vector<pid_t> children;
+    bool configured = false;
+    uint32_t exchange_ticks = 1;
+    uint64_t exchange_rounds = 0;
+    uint64_t tick = 0;
+    population_t pop;
+    tick_counts_t last_counts;
+    arena_t scratch;
+};
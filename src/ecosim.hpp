@@ -0,0 +1,799 @@
+#pragma once
+
+#include "grid_memory.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+static const uint32_t NUM_ROWS = 15;
+
+// Constants
+const uint32_t PLANT_MAXIMUM_AGE = 10;
+const uint32_t HERBIVORE_MAXIMUM_AGE = 50;
+const uint32_t CARNIVORE_MAXIMUM_AGE = 80;
+const uint32_t MAXIMUM_ENERGY = 200;
+const uint32_t THRESHOLD_ENERGY_FOR_REPRODUCTION = 20;
+
+// Probabilities
+const double PLANT_REPRODUCTION_PROBABILITY = 0.2;
+const double HERBIVORE_REPRODUCTION_PROBABILITY = 0.075;
+const double CARNIVORE_REPRODUCTION_PROBABILITY = 0.025;
+const double HERBIVORE_MOVE_PROBABILITY = 0.7;
+const double HERBIVORE_EAT_PROBABILITY = 0.9;
+const double CARNIVORE_MOVE_PROBABILITY = 0.5;
+const double CARNIVORE_EAT_PROBABILITY = 1.0;
+
+// Energy
+const int32_t MOVE_ENERGY_COST = 5;
+const int32_t REPRODUCTION_ENERGY_COST = 10;
+const int32_t HERBIVORE_EAT_ENERGY = 30;
+const int32_t CARNIVORE_EAT_ENERGY = 20;
+
+// Type definitions
+enum entity_type_t
+{
+    empty,
+    plant,
+    herbivore,
+    carnivore
+};
+
+struct pos_t
+{
+    uint32_t i;
+    uint32_t j;
+};
+
+struct entity_t
+{
+    entity_type_t type;
+    int32_t energy;
+    int32_t age;
+};
+
+const entity_t newEmpty = {entity_type_t::empty, 0, 0};
+const entity_t newPlant = {entity_type_t::plant, 0, PLANT_MAXIMUM_AGE};
+const entity_t newHerbivore = {entity_type_t::herbivore, MAXIMUM_ENERGY, HERBIVORE_MAXIMUM_AGE};
+const entity_t newCarnivore = {entity_type_t::carnivore, MAXIMUM_ENERGY, CARNIVORE_MAXIMUM_AGE};
+
+//Celula da grade compactada em 32 bits: tipo (bits 0-1), 8 bits baixos da
+//energia (bits 2-9), idade (bits 10-17), 4 bits altos da energia, com sinal
+//(bits 18-21), e 10 bits de marcadores que acompanham o ser quando ele se move.
+//A celula vazia e 0. Com energia em [0, 255], como nas regras de intencoes, os
+//bits altos sao 0. entity_t continua sendo a forma expandida, usada fora do
+//kernel (JSON, construcao dos seres).
+struct cell_t
+{
+    uint32_t bits;
+};
+
+const uint32_t CELL_ENERGY_SHIFT = 2;
+const uint32_t CELL_AGE_SHIFT = 10;
+const uint32_t CELL_ENERGY_HIGH_SHIFT = 18;
+const uint32_t CELL_FLAGS_SHIFT = 22;
+const uint32_t CELL_FIELD_MASK = 0xFF;
+const int32_t CELL_MIN_ENERGY = -2048;
+const int32_t CELL_MAX_ENERGY = 2047;
+
+//Nas regras originais a energia nao tem teto e o movimento nao mata, mas cada
+//vez que um ser age ele envelhece um tick: a energia fica entre a inicial menos
+//um movimento por tick de vida e a inicial mais uma refeicao por tick de vida
+static_assert((int32_t)MAXIMUM_ENERGY + (int32_t)HERBIVORE_MAXIMUM_AGE * HERBIVORE_EAT_ENERGY <= CELL_MAX_ENERGY &&
+                  (int32_t)MAXIMUM_ENERGY + (int32_t)CARNIVORE_MAXIMUM_AGE * CARNIVORE_EAT_ENERGY <= CELL_MAX_ENERGY &&
+                  (int32_t)MAXIMUM_ENERGY - (int32_t)std::max(HERBIVORE_MAXIMUM_AGE, CARNIVORE_MAXIMUM_AGE) * MOVE_ENERGY_COST >= CELL_MIN_ENERGY,
+              "energy must fit in 12 bits");
+static_assert(PLANT_MAXIMUM_AGE <= CELL_FIELD_MASK && HERBIVORE_MAXIMUM_AGE <= CELL_FIELD_MASK && CARNIVORE_MAXIMUM_AGE <= CELL_FIELD_MASK,
+              "age must fit in 8 bits");
+
+const cell_t EMPTY_CELL = {0};
+
+inline entity_type_t cellType(cell_t c) { return (entity_type_t)(c.bits & 3); }
+inline int32_t cellEnergy(cell_t c)
+{
+    int32_t high = (int32_t)(c.bits << (32 - CELL_FLAGS_SHIFT)) >> 28;
+    return high * 256 + (int32_t)((c.bits >> CELL_ENERGY_SHIFT) & CELL_FIELD_MASK);
+}
+inline int32_t cellAge(cell_t c) { return (int32_t)((c.bits >> CELL_AGE_SHIFT) & CELL_FIELD_MASK); }
+inline uint32_t cellFlags(cell_t c) { return c.bits >> CELL_FLAGS_SHIFT; }
+
+//Troca energia (em [CELL_MIN_ENERGY, CELL_MAX_ENERGY]) e idade (em [0, 255]),
+//mantendo tipo e marcadores
+inline cell_t withEnergyAge(cell_t c, int32_t energy, int32_t age)
+{
+    const uint32_t fields = (CELL_FIELD_MASK << CELL_ENERGY_SHIFT) | (CELL_FIELD_MASK << CELL_AGE_SHIFT) | (0xFu << CELL_ENERGY_HIGH_SHIFT);
+    return {(c.bits & ~fields) | (((uint32_t)energy & CELL_FIELD_MASK) << CELL_ENERGY_SHIFT) | ((uint32_t)age << CELL_AGE_SHIFT) |
+            ((((uint32_t)energy >> 8) & 0xF) << CELL_ENERGY_HIGH_SHIFT)};
+}
+
+inline cell_t withFlags(cell_t c, uint32_t flags) { return {(c.bits & ((1u << CELL_FLAGS_SHIFT) - 1)) | (flags << CELL_FLAGS_SHIFT)}; }
+
+inline cell_t packCell(const entity_t &e) { return withEnergyAge({(uint32_t)e.type}, e.energy, e.age); }
+
+inline entity_t unpackCell(cell_t c) { return {cellType(c), cellEnergy(c), cellAge(c)}; }
+
+//Parametros de comportamento das especies, por padrao iguais as constantes acima
+struct species_params_t
+{
+    double plant_reproduction_probability = PLANT_REPRODUCTION_PROBABILITY;
+    double herbivore_reproduction_probability = HERBIVORE_REPRODUCTION_PROBABILITY;
+    double carnivore_reproduction_probability = CARNIVORE_REPRODUCTION_PROBABILITY;
+    double herbivore_move_probability = HERBIVORE_MOVE_PROBABILITY;
+    double herbivore_eat_probability = HERBIVORE_EAT_PROBABILITY;
+    double carnivore_move_probability = CARNIVORE_MOVE_PROBABILITY;
+    double carnivore_eat_probability = CARNIVORE_EAT_PROBABILITY;
+    int32_t threshold_energy_for_reproduction = THRESHOLD_ENERGY_FOR_REPRODUCTION;
+};
+
+//Contagem de seres por especie
+struct population_t
+{
+    uint32_t plants = 0;
+    uint32_t herbivores = 0;
+    uint32_t carnivores = 0;
+
+    population_t &operator+=(const population_t &o)
+    {
+        plants += o.plants;
+        herbivores += o.herbivores;
+        carnivores += o.carnivores;
+        return *this;
+    }
+    bool operator==(const population_t &o) const
+    {
+        return plants == o.plants && herbivores == o.herbivores && carnivores == o.carnivores;
+    }
+};
+
+//Eventos de um tick por especie (indice = entity_type_t). Cada thread ou
+//subdominio acumula os seus e eles sao somados na barreira do fim do tick.
+struct tick_counts_t
+{
+    uint64_t births[4] = {0, 0, 0, 0};
+    uint64_t deaths[4] = {0, 0, 0, 0};
+    uint64_t eats[4] = {0, 0, 0, 0};
+
+    tick_counts_t &operator+=(const tick_counts_t &o)
+    {
+        for (int t = 0; t < 4; t++)
+        {
+            births[t] += o.births[t];
+            deaths[t] += o.deaths[t];
+            eats[t] += o.eats[t];
+        }
+        return *this;
+    }
+};
+
+//Atualiza a populacao com os nascimentos e mortes de um tick
+inline void addCounts(population_t &pop, const tick_counts_t &c)
+{
+    pop.plants += (uint32_t)(c.births[plant] - c.deaths[plant]);
+    pop.herbivores += (uint32_t)(c.births[herbivore] - c.deaths[herbivore]);
+    pop.carnivores += (uint32_t)(c.births[carnivore] - c.deaths[carnivore]);
+}
+
+//Raio de dependencia de um tick: o novo estado de uma celula depende apenas
+//do estado anterior das celulas a ate TICK_RADIUS passos (vizinhanca de 4)
+const uint32_t TICK_RADIUS = 3;
+
+//Intencao de acao de um ser no tick: tipo (2 bits altos) e direcao (2 bits baixos)
+enum claim_kind_t : uint8_t
+{
+    claim_none = 0,
+    claim_eat = 1,
+    claim_move = 2,
+    claim_birth = 3
+};
+
+//Resultado da disputa por uma celula: direcao do vencedor ou NO_WINNER
+const uint8_t NO_WINNER = 0xFF;
+
+//Ordem das celulas na memoria: linha a linha, ou em ladrilhos de 8x8 celulas
+//(ladrilhos linha a linha, celulas do ladrilho em ordem de Morton/Z), em que
+//os vizinhos de cima e de baixo ficam quase sempre na mesma linha de cache
+enum grid_layout_t : uint8_t
+{
+    layout_row_major,
+    layout_morton
+};
+
+//Lado (log2) do ladrilho do layout de Morton
+const uint32_t MORTON_TILE_BITS = 3;
+
+//Lado (log2) dos ladrilhos marcados quando alguma celula muda de especie
+const uint32_t DIRTY_TILE_BITS = 4;
+
+//Espalha os bits de x para as posicoes pares (x < 2^MORTON_TILE_BITS)
+inline uint32_t mortonSpread(uint32_t x)
+{
+    uint32_t out = 0;
+    for (uint32_t b = 0; b < MORTON_TILE_BITS; b++) out |= ((x >> b) & 1) << (2 * b);
+    return out;
+}
+
+//Estado completo de uma simulacao: grade, parametros e gerador.
+//A grade pode ser uma janela [row0, row0 + rows) x [col0, col0 + cols) de um
+//mundo maior (world_rows x world_cols), como nos subdominios distribuidos.
+//O indice de (i, j) em todos os planos e row_base[i] + col_base[j], o que vale
+//para os dois layouts e torna o indice de um vizinho tao barato quanto o da
+//propria celula.
+struct world_t
+{
+    uint32_t rows = 0;
+    uint32_t cols = 0;
+    int32_t row0 = 0;
+    int32_t col0 = 0;
+    uint32_t world_rows = 0;
+    uint32_t world_cols = 0;
+    species_params_t params;
+    uint64_t seed = 0;
+    uint64_t tick = 0;
+    std::mt19937 gen;
+    grid_vector_t<cell_t> entity_grid;
+    grid_vector_t<cell_t> next_grid;
+    grid_vector_t<uint8_t> claims;
+    grid_vector_t<uint8_t> winners;
+    grid_layout_t layout = layout_row_major;
+    //Populacao mantida pelos eventos de cada tick e eventos do ultimo tick
+    population_t population;
+    tick_counts_t last_counts;
+    std::vector<size_t> row_base;
+    std::vector<uint32_t> col_base;
+    //Um byte por ladrilho de 2^DIRTY_TILE_BITS celulas de lado: alguma celula
+    //mudou de especie desde que o consumidor (a piramide de densidade) leu
+    std::vector<uint8_t> dirty;
+    uint32_t dirty_cols = 0;
+
+    world_t() = default;
+    world_t(uint32_t rows, uint32_t cols) { resize(rows, cols); }
+
+    void resize(uint32_t r, uint32_t c)
+    {
+        resizeWindow(r, c, 0, 0, r, c);
+    }
+
+    //Com clear = false os buffers ficam sem inicializar: quem chama deve
+    //passar clearRows em todas as linhas (ver placeWorld)
+    void resizeWindow(uint32_t r, uint32_t c, int32_t i0, int32_t j0, uint32_t worldRows, uint32_t worldCols, bool clear = true)
+    {
+        rows = r;
+        cols = c;
+        row0 = i0;
+        col0 = j0;
+        world_rows = worldRows;
+        world_cols = worldCols;
+
+        size_t cells = (size_t)rows * cols;
+        row_base.resize(rows);
+        col_base.resize(cols);
+        if (layout == layout_row_major)
+        {
+            for (uint32_t i = 0; i < rows; i++) row_base[i] = (size_t)i * cols;
+            for (uint32_t j = 0; j < cols; j++) col_base[j] = j;
+        }
+        else
+        {
+            const uint32_t side = 1u << MORTON_TILE_BITS, mask = side - 1;
+            size_t tileRows = (rows + mask) >> MORTON_TILE_BITS, tileCols = (cols + mask) >> MORTON_TILE_BITS;
+            for (uint32_t i = 0; i < rows; i++) row_base[i] = (i >> MORTON_TILE_BITS) * tileCols * side * side + 2 * mortonSpread(i & mask);
+            for (uint32_t j = 0; j < cols; j++) col_base[j] = (j >> MORTON_TILE_BITS) * side * side + mortonSpread(j & mask);
+            cells = tileRows * tileCols * side * side;
+        }
+
+        //Buffers novos, sem escrever nada: as paginas sao tocadas por clearRows
+        entity_grid = grid_vector_t<cell_t>(cells);
+        next_grid = grid_vector_t<cell_t>(cells);
+        claims = grid_vector_t<uint8_t>(cells);
+        winners = grid_vector_t<uint8_t>(cells);
+        if (clear) clearRows(0, rows);
+
+        const uint32_t tile = (1u << DIRTY_TILE_BITS) - 1;
+        dirty_cols = (cols + tile) >> DIRTY_TILE_BITS;
+        dirty.assign((size_t)((rows + tile) >> DIRTY_TILE_BITS) * dirty_cols, 1);
+    }
+
+    //Troca o layout da grade (a grade e esvaziada)
+    void setLayout(grid_layout_t l)
+    {
+        layout = l;
+        resizeWindow(rows, cols, row0, col0, world_rows, world_cols);
+    }
+
+    //Esvazia a grade sem realocar, para reaproveitar o buffer entre simulacoes
+    void reset(uint64_t s)
+    {
+        std::fill(entity_grid.begin(), entity_grid.end(), EMPTY_CELL);
+        population = population_t();
+        last_counts = tick_counts_t();
+        touchAll();
+        seed = s;
+        tick = 0;
+        gen.seed((std::mt19937::result_type)(seed ^ (seed >> 32)));
+    }
+
+    //Inicializa as linhas [r0, r1) dos quatro buffers. No layout de Morton r0 e
+    //r1 devem ser multiplos do ladrilho (ou r1 = rows); as celulas de
+    //preenchimento ficam sempre vazias.
+    void clearRows(uint32_t r0, uint32_t r1)
+    {
+        size_t begin = rowStart(r0), end = rowStart(r1);
+        std::fill(entity_grid.begin() + begin, entity_grid.begin() + end, EMPTY_CELL);
+        std::fill(next_grid.begin() + begin, next_grid.begin() + end, EMPTY_CELL);
+        std::fill(claims.begin() + begin, claims.begin() + end, claim_none);
+        std::fill(winners.begin() + begin, winners.begin() + end, NO_WINNER);
+    }
+
+    //Inicio da linha r nos buffers (r = rows da o fim); no layout de Morton, r
+    //deve ser multiplo do ladrilho
+    size_t rowStart(uint32_t r) const { return r < rows ? row_base[r] : entity_grid.size(); }
+
+    size_t index(int i, int j) const { return row_base[i] + col_base[j]; }
+    cell_t &at(int i, int j) { return entity_grid[index(i, j)]; }
+    const cell_t &at(int i, int j) const { return entity_grid[index(i, j)]; }
+    bool inside(int i, int j) const { return i >= 0 && j >= 0 && i < (int)rows && j < (int)cols; }
+
+    void touch(uint32_t i, uint32_t j) { dirty[(size_t)(i >> DIRTY_TILE_BITS) * dirty_cols + (j >> DIRTY_TILE_BITS)] = 1; }
+    void touchAll() { std::fill(dirty.begin(), dirty.end(), 1); }
+};
+
+namespace ecosim
+{
+    //Direcoes na ordem original: baixo, cima, esquerda, direita (oposta = d ^ 1)
+    static const int DI[4] = {1, -1, 0, 0};
+    static const int DJ[4] = {0, 0, -1, 1};
+
+    enum stream_t : uint64_t
+    {
+        stream_eat,
+        stream_move,
+        stream_birth,
+        stream_choice,
+        stream_priority
+    };
+
+    inline uint64_t mix(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    //Numero aleatorio determinado por (semente, tick, celula global, fluxo): nao
+    //depende da ordem de varredura, do numero de threads nem da particao da grade
+    inline uint64_t random(const world_t &w, int i, int j, uint64_t stream)
+    {
+        uint64_t cell = (uint64_t)(w.row0 + i) * w.world_cols + (uint64_t)(w.col0 + j);
+        return mix(w.seed + mix(w.tick + mix((cell << 3) | stream)));
+    }
+
+    inline double roll(const world_t &w, int i, int j, uint64_t stream)
+    {
+        return (random(w, i, j, stream) >> 11) * 0x1.0p-53;
+    }
+
+    inline uint8_t claimOf(claim_kind_t kind, int dir) { return (uint8_t)((kind << 2) | dir); }
+    inline claim_kind_t claimKind(uint8_t claim) { return (claim_kind_t)(claim >> 2); }
+    inline int claimDir(uint8_t claim) { return claim & 3; }
+
+    //Sorteia uma das celulas adjacentes do tipo pedido, ou -1 se nao houver
+    inline int chooseNeighbour(const world_t &w, int i, int j, entity_type_t type)
+    {
+        int dirs[4], total = 0;
+        for (int d = 0; d < 4; d++)
+        {
+            int I = i + DI[d], J = j + DJ[d];
+            if (w.inside(I, J) && cellType(w.at(I, J)) == type) dirs[total++] = d;
+        }
+        if (total == 0) return -1;
+        return dirs[random(w, i, j, stream_choice) % total];
+    }
+
+    //Fase 1: cada ser decide, olhando apenas o estado anterior, no maximo uma
+    //acao (comer, mover ou reproduzir/crescer) e a celula adjacente alvo
+    inline uint8_t decide(const world_t &w, int i, int j)
+    {
+        cell_t c = w.at(i, j);
+        entity_type_t type = cellType(c);
+        const species_params_t &p = w.params;
+        if (type == entity_type_t::empty || cellAge(c) <= 1) return claim_none;
+
+        if (type == entity_type_t::plant)
+        {
+            if (roll(w, i, j, stream_birth) >= p.plant_reproduction_probability) return claim_none;
+            int d = chooseNeighbour(w, i, j, entity_type_t::empty);
+            return d < 0 ? (uint8_t)claim_none : claimOf(claim_birth, d);
+        }
+
+        bool herb = type == entity_type_t::herbivore;
+        entity_type_t prey = herb ? entity_type_t::plant : entity_type_t::herbivore;
+        double eatP = herb ? p.herbivore_eat_probability : p.carnivore_eat_probability;
+        double moveP = herb ? p.herbivore_move_probability : p.carnivore_move_probability;
+        double birthP = herb ? p.herbivore_reproduction_probability : p.carnivore_reproduction_probability;
+
+        int d;
+        if (roll(w, i, j, stream_eat) < eatP && (d = chooseNeighbour(w, i, j, prey)) >= 0) return claimOf(claim_eat, d);
+        if (roll(w, i, j, stream_move) < moveP && (d = chooseNeighbour(w, i, j, entity_type_t::empty)) >= 0) return claimOf(claim_move, d);
+        if (cellEnergy(c) >= p.threshold_energy_for_reproduction && roll(w, i, j, stream_birth) < birthP &&
+            (d = chooseNeighbour(w, i, j, entity_type_t::empty)) >= 0)
+            return claimOf(claim_birth, d);
+        return claim_none;
+    }
+
+    //Fase 2: cada celula escolhe, entre os vizinhos que a disputam, o de maior
+    //prioridade aleatoria (presa: quem come; celula vazia: quem entra ou nasce)
+    inline uint8_t resolve(const world_t &w, int i, int j)
+    {
+        bool occupied = cellType(w.at(i, j)) != entity_type_t::empty;
+        uint8_t winner = NO_WINNER;
+        uint64_t best = 0;
+        for (int d = 0; d < 4; d++)
+        {
+            int I = i + DI[d], J = j + DJ[d];
+            if (!w.inside(I, J)) continue;
+
+            uint8_t claim = w.claims[w.index(I, J)];
+            claim_kind_t kind = claimKind(claim);
+            if (kind == claim_none || claimDir(claim) != (d ^ 1)) continue;
+            if (occupied != (kind == claim_eat)) continue;
+
+            uint64_t priority = random(w, I, J, stream_priority);
+            if (winner == NO_WINNER || priority > best)
+            {
+                winner = (uint8_t)d;
+                best = priority;
+            }
+        }
+        return winner;
+    }
+
+    inline uint8_t winnerAt(const world_t &w, int i, int j)
+    {
+        return w.inside(i, j) ? w.winners[w.index(i, j)] : NO_WINNER;
+    }
+
+    //A disputa pela celula alvo da acao de (i, j) foi vencida por ele?
+    inline bool claimWon(const world_t &w, int i, int j, uint8_t claim)
+    {
+        int d = claimDir(claim);
+        return winnerAt(w, i + DI[d], j + DJ[d]) == (d ^ 1);
+    }
+
+    //Fase 3: compoe o novo estado da celula a partir das acoes vencedoras.
+    //Um ser comido neste tick nao se move nem se reproduz, mas o que ele comeu
+    //continua comido: todas as refeicoes acontecem ao mesmo tempo.
+    //Cada morte e contada na celula onde o ser estava (ou onde chegaria, se
+    //morre de fome ao se mover) e cada nascimento na celula do filhote.
+    inline cell_t apply(const world_t &w, int i, int j, tick_counts_t &counts)
+    {
+        cell_t c = w.at(i, j);
+        entity_type_t type = cellType(c);
+        if (type != entity_type_t::empty)
+        {
+            if (cellAge(c) <= 1 || winnerAt(w, i, j) != NO_WINNER)
+            {
+                counts.deaths[type]++;
+                return EMPTY_CELL;
+            }
+
+            uint8_t claim = w.claims[w.index(i, j)];
+            claim_kind_t kind = claimKind(claim);
+            int32_t energy = cellEnergy(c);
+            if (kind != claim_none && claimWon(w, i, j, claim))
+            {
+                if (kind == claim_move) return EMPTY_CELL;
+                if (kind == claim_birth && type != entity_type_t::plant) energy -= REPRODUCTION_ENERGY_COST;
+                if (kind == claim_eat)
+                {
+                    counts.eats[type]++;
+                    int32_t gain = type == entity_type_t::herbivore ? HERBIVORE_EAT_ENERGY : CARNIVORE_EAT_ENERGY;
+                    energy = std::min<int32_t>(energy + gain, MAXIMUM_ENERGY);
+                }
+            }
+            if (type != entity_type_t::plant && energy <= 0)
+            {
+                counts.deaths[type]++;
+                return EMPTY_CELL;
+            }
+            return withEnergyAge(c, energy, cellAge(c) - 1);
+        }
+
+        uint8_t from = winnerAt(w, i, j);
+        if (from == NO_WINNER) return EMPTY_CELL;
+
+        int I = i + DI[from], J = j + DJ[from];
+        if (winnerAt(w, I, J) != NO_WINNER) return EMPTY_CELL;
+
+        cell_t src = w.at(I, J);
+        if (claimKind(w.claims[w.index(I, J)]) == claim_move)
+        {
+            int32_t energy = cellEnergy(src) - MOVE_ENERGY_COST;
+            if (energy > 0) return withEnergyAge(src, energy, cellAge(src) - 1);
+            counts.deaths[cellType(src)]++;
+            return EMPTY_CELL;
+        }
+        counts.births[cellType(src)]++;
+        if (cellType(src) == entity_type_t::plant) return packCell(newPlant);
+        return packCell(cellType(src) == entity_type_t::herbivore ? newHerbivore : newCarnivore);
+    }
+
+    //As fases rodam sobre as linhas [r0, r1) e colunas [c0, c1) da janela
+    inline void decideRows(world_t &w, uint32_t r0, uint32_t r1, uint32_t c0 = 0, uint32_t c1 = UINT32_MAX)
+    {
+        c1 = std::min(c1, w.cols);
+        for (uint32_t i = r0; i < r1; i++)
+        {
+            for (uint32_t j = c0; j < c1; j++) w.claims[w.index(i, j)] = decide(w, i, j);
+        }
+    }
+
+    inline void resolveRows(world_t &w, uint32_t r0, uint32_t r1, uint32_t c0 = 0, uint32_t c1 = UINT32_MAX)
+    {
+        c1 = std::min(c1, w.cols);
+        for (uint32_t i = r0; i < r1; i++)
+        {
+            for (uint32_t j = c0; j < c1; j++) w.winners[w.index(i, j)] = resolve(w, i, j);
+        }
+    }
+
+    inline void applyRows(world_t &w, tick_counts_t &counts, uint32_t r0, uint32_t r1, uint32_t c0 = 0, uint32_t c1 = UINT32_MAX)
+    {
+        c1 = std::min(c1, w.cols);
+        for (uint32_t i = r0; i < r1; i++)
+        {
+            for (uint32_t j = c0; j < c1; j++)
+            {
+                size_t k = w.index(i, j);
+                w.next_grid[k] = apply(w, i, j, counts);
+                if (cellType(w.next_grid[k]) != cellType(w.entity_grid[k])) w.touch(i, j);
+            }
+        }
+    }
+
+    //Fim do tick: a grade nova passa a ser a atual e os eventos somados do
+    //tick atualizam a populacao
+    inline void finishTick(world_t &w, const tick_counts_t &counts)
+    {
+        w.entity_grid.swap(w.next_grid);
+        w.tick++;
+        addCounts(w.population, counts);
+        w.last_counts = counts;
+    }
+}
+
+//Avanca a simulacao uma etapa de tempo. Todas as celulas decidem sobre o mesmo
+//estado anterior, entao o resultado nao depende da ordem de varredura.
+inline void nextIteration(world_t &w)
+{
+    tick_counts_t counts;
+    ecosim::decideRows(w, 0, w.rows);
+    ecosim::resolveRows(w, 0, w.rows);
+    ecosim::applyRows(w, counts, 0, w.rows);
+    ecosim::finishTick(w, counts);
+}
+
+//Regras do tick: as originais (nextIterationOriginal) ou as de intencoes
+//(nextIteration), que nao dependem da ordem de varredura
+enum tick_rules_t : uint8_t
+{
+    rules_original,
+    rules_claims
+};
+
+//Regras originais do EcoSim: a grade e percorrida linha a linha e cada ser age
+//na hora sobre ela mesma, com o gerador do mundo. Um ser envelhece, come, se
+//move e se reproduz no mesmo tick; quem se move ou nasce para baixo ou para a
+//direita age de novo quando a varredura chega a ele. O resultado depende da
+//ordem de varredura, entao os motores paralelo, esparso, em arquivo e
+//particionados rodam as regras de intencoes de nextIteration.
+namespace original
+{
+    //Sorteios direto da saida do mt19937 (fixada pelo padrao, ao contrario das
+    //distribuicoes), para que a mesma semente de a mesma simulacao em qualquer
+    //biblioteca padrao
+    inline double roll(world_t &w) { return w.gen() * 0x1.0p-32; }
+    inline int pick(world_t &w, int total) { return (int)(w.gen() % (uint32_t)total); }
+
+    //Coleta as celulas adjacentes (baixo, cima, esquerda, direita) de um tipo
+    inline int neighbours(const world_t &w, int i, int j, entity_type_t type, pos_t out[4])
+    {
+        int total = 0;
+        for (int d = 0; d < 4; d++)
+        {
+            int I = i + ecosim::DI[d], J = j + ecosim::DJ[d];
+            if (w.inside(I, J) && cellType(w.at(I, J)) == type) out[total++] = {(uint32_t)I, (uint32_t)J};
+        }
+        return total;
+    }
+
+    inline void put(world_t &w, pos_t p, cell_t c)
+    {
+        w.at(p.i, p.j) = c;
+        w.touch(p.i, p.j);
+    }
+
+    //Simula o envelhecimento dos seres do sistema
+    inline void ageSimulation(world_t &w, int i, int j, tick_counts_t &counts)
+    {
+        cell_t space = w.at(i, j);
+        entity_type_t type = cellType(space);
+        if (type == entity_type_t::empty) return;
+        if (cellAge(space) <= 1)
+        {
+            counts.deaths[type]++;
+            put(w, {(uint32_t)i, (uint32_t)j}, EMPTY_CELL);
+            return;
+        }
+        w.at(i, j) = withEnergyAge(space, cellEnergy(space), cellAge(space) - 1);
+    }
+
+    //Faz uma planta crescer em um espaco adjacente
+    inline void growth(world_t &w, int i, int j, tick_counts_t &counts)
+    {
+        pos_t possibilities[4];
+        int valueTot = neighbours(w, i, j, entity_type_t::empty, possibilities);
+        if (valueTot == 0) return;
+
+        put(w, possibilities[pick(w, valueTot)], packCell(newPlant));
+        counts.births[plant]++;
+    }
+
+    //Movimentacao do herbivoro ou carnivoro, retorna a nova posicao
+    inline pos_t walk(world_t &w, int i, int j)
+    {
+        pos_t possibilities[4];
+        int valueTot = neighbours(w, i, j, entity_type_t::empty, possibilities);
+        if (valueTot == 0) return {(uint32_t)i, (uint32_t)j};
+
+        pos_t p = possibilities[pick(w, valueTot)];
+        cell_t c = w.at(i, j);
+        put(w, p, withEnergyAge(c, cellEnergy(c) - MOVE_ENERGY_COST, cellAge(c)));
+        put(w, {(uint32_t)i, (uint32_t)j}, EMPTY_CELL);
+        return p;
+    }
+
+    //Herbivoro ou carnivoro come a primeira presa adjacente
+    inline void eat(world_t &w, int i, int j, entity_type_t prey, int32_t gainEnergy, tick_counts_t &counts)
+    {
+        pos_t possibilities[4];
+        if (neighbours(w, i, j, prey, possibilities) == 0) return;
+
+        put(w, possibilities[0], EMPTY_CELL);
+        counts.deaths[prey]++;
+        cell_t c = w.at(i, j);
+        w.at(i, j) = withEnergyAge(c, cellEnergy(c) + gainEnergy, cellAge(c));
+        counts.eats[cellType(c)]++;
+    }
+
+    //Herbivoro ou carnivoro se reproduz na primeira celula vazia adjacente
+    inline void reproduce(world_t &w, int i, int j, const entity_t &animal, tick_counts_t &counts)
+    {
+        pos_t possibilities[4];
+        if (neighbours(w, i, j, entity_type_t::empty, possibilities) == 0) return;
+
+        put(w, possibilities[0], packCell(animal));
+        counts.births[animal.type]++;
+        cell_t c = w.at(i, j);
+        int32_t energy = cellEnergy(c) - REPRODUCTION_ENERGY_COST;
+        if (energy > 0)
+        {
+            w.at(i, j) = withEnergyAge(c, energy, cellAge(c));
+            return;
+        }
+        put(w, {(uint32_t)i, (uint32_t)j}, EMPTY_CELL);
+        counts.deaths[animal.type]++;
+    }
+
+    //Acao do herbivoro ou do carnivoro: come, se move e se reproduz, cada um
+    //com o seu sorteio
+    inline void action(world_t &w, int i, int j, tick_counts_t &counts)
+    {
+        const species_params_t &p = w.params;
+        bool herb = cellType(w.at(i, j)) == entity_type_t::herbivore;
+        if (roll(w) <= (herb ? p.herbivore_eat_probability : p.carnivore_eat_probability))
+            eat(w, i, j, herb ? entity_type_t::plant : entity_type_t::herbivore, herb ? HERBIVORE_EAT_ENERGY : CARNIVORE_EAT_ENERGY, counts);
+        if (roll(w) <= (herb ? p.herbivore_move_probability : p.carnivore_move_probability))
+        {
+            pos_t to = walk(w, i, j);
+            i = to.i;
+            j = to.j;
+        }
+        if (roll(w) <= (herb ? p.herbivore_reproduction_probability : p.carnivore_reproduction_probability) &&
+            cellEnergy(w.at(i, j)) >= p.threshold_energy_for_reproduction)
+            reproduce(w, i, j, herb ? newHerbivore : newCarnivore, counts);
+    }
+}
+
+//Avanca a simulacao uma etapa de tempo com as regras originais, sobre a propria
+//grade (next_grid e os planos de intencoes nao sao usados). Um ser so escreve
+//na propria linha e nas vizinhas: antes de cada linha i, beforeRow(i + 1)
+//avisa ate que linha a varredura vai escrever (ver checkpoint_writer_t).
+template <class F>
+inline void nextIterationOriginal(world_t &w, F &&beforeRow)
+{
+    tick_counts_t counts;
+    for (int i = 0; i < (int)w.rows; i++)
+    {
+        beforeRow((uint32_t)std::min(i + 1, (int)w.rows - 1));
+        for (int j = 0; j < (int)w.cols; j++)
+        {
+            original::ageSimulation(w, i, j, counts);
+
+            entity_type_t type = cellType(w.at(i, j));
+            if (type == entity_type_t::carnivore || type == entity_type_t::herbivore) original::action(w, i, j, counts);
+            if (type == entity_type_t::plant && original::roll(w) < w.params.plant_reproduction_probability) original::growth(w, i, j, counts);
+        }
+    }
+    w.tick++;
+    addCounts(w.population, counts);
+    w.last_counts = counts;
+}
+
+inline void nextIterationOriginal(world_t &w)
+{
+    nextIterationOriginal(w, [](uint32_t) {});
+}
+
+//Coloca uma entidade em uma celula vazia aleatoria (a grade nao pode estar cheia).
+//A saida do mt19937 e fixada pelo padrao, mas a de uniform_int_distribution nao:
+//a escala e feita aqui para que a mesma semente gere o mesmo mundo em qualquer
+//biblioteca padrao.
+inline void placeRandom(world_t &w, const entity_t &e)
+{
+    size_t cells = (size_t)w.rows * w.cols;
+    uint64_t draw = ((uint64_t)w.gen() << 32) | w.gen();
+    size_t k = (size_t)(draw % cells);
+    while (cellType(w.at(k / w.cols, k % w.cols)) != entity_type_t::empty) k = (k + 1) % cells;
+    w.at(k / w.cols, k % w.cols) = packCell(e);
+    w.touch(k / w.cols, k % w.cols);
+
+    tick_counts_t placed;
+    placed.births[e.type] = 1;
+    addCounts(w.population, placed);
+}
+
+//Inicia o sistema com os dados colocados no inicio da simulacao
+inline void startEcoSim(world_t &w, uint32_t NUM_PLANTS, uint32_t NUM_HERBV, uint32_t NUM_CARNV)
+{
+    for (uint32_t stop = 0; stop < NUM_PLANTS; stop++) placeRandom(w, newPlant);
+    for (uint32_t stop = 0; stop < NUM_HERBV; stop++) placeRandom(w, newHerbivore);
+    for (uint32_t stop = 0; stop < NUM_CARNV; stop++) placeRandom(w, newCarnivore);
+}
+
+//Conta os seres vivos de cada especie
+inline population_t countPopulation(const world_t &w)
+{
+    population_t pop;
+    for (cell_t c : w.entity_grid)
+    {
+        entity_type_t type = cellType(c);
+        pop.plants += type == entity_type_t::plant;
+        pop.herbivores += type == entity_type_t::herbivore;
+        pop.carnivores += type == entity_type_t::carnivore;
+    }
+    return pop;
+}
+
+//Hash FNV-1a do estado da grade, para comparar execucoes. Usa os campos
+//expandidos (tipo, energia, idade) em ordem de linhas, independente da
+//codificacao e do layout da celula.
+inline uint64_t gridHash(const world_t &w)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t k = 0; k < (size_t)w.rows * w.cols; k++)
+    {
+        cell_t c = w.at(k / w.cols, k % w.cols);
+        const int32_t fields[3] = {(int32_t)cellType(c), cellEnergy(c), cellAge(c)};
+        for (int32_t f : fields)
+        {
+            for (int b = 0; b < 4; b++)
+            {
+                h ^= (uint8_t)(f >> (8 * b));
+                h *= 0x100000001b3ULL;
+            }
+        }
+    }
+    return h;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//Numeros do cache de quadros, para relatorio
+struct frame_cache_stats_t
+{
+    uint64_t hits = 0;
+    uint64_t renders = 0;
+};
+
+//Quadros ja serializados, imutaveis e compartilhados por contagem de
+//referencias: cada estado do mundo (key: a versao do mundo ao vivo, ou o tick
+//de uma trajetoria) e serializado uma unica vez por formato, e todos os
+//pedidos desse estado recebem o mesmo buffer. Guarda ate `capacity` quadros;
+//o usado ha mais tempo sai primeiro. Um quadro que saiu do cache continua
+//valido para quem ainda o segura.
+class frame_cache_t
+{
+public:
+    typedef std::shared_ptr<const std::string> frame_t;
+
+    explicit frame_cache_t(size_t capacity) : entries(std::max<size_t>(capacity, 1)) {}
+
+    frame_cache_t(const frame_cache_t &) = delete;
+    frame_cache_t &operator=(const frame_cache_t &) = delete;
+
+    //Quadro guardado de (key, format), ou nulo
+    frame_t find(uint64_t key, uint32_t format)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        for (entry_t &e : entries)
+        {
+            if (e.frame && e.key == key && e.format == format)
+            {
+                e.used = ++clock;
+                current.hits++;
+                return e.frame;
+            }
+        }
+        return frame_t();
+    }
+
+    //Quadro de (key, format): o guardado ou, se nao ha, o que render() devolve
+    //(chamado fora da trava do cache; quem chama garante que o estado de key
+    //nao muda durante render)
+    template <class F>
+    frame_t get(uint64_t key, uint32_t format, F &&render)
+    {
+        if (frame_t hit = find(key, format)) return hit;
+        frame_t frame = std::make_shared<const std::string>(render());
+        std::lock_guard<std::mutex> lock(mtx);
+        current.renders++;
+        entry_t *slot = &entries[0];
+        for (entry_t &e : entries)
+        {
+            //Outro pedido pode ter serializado o mesmo estado enquanto isso
+            if (e.frame && e.key == key && e.format == format) return e.frame;
+            if (e.used < slot->used) slot = &e;
+        }
+        slot->key = key;
+        slot->format = format;
+        slot->frame = frame;
+        slot->used = ++clock;
+        return frame;
+    }
+
+    frame_cache_stats_t stats() const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return current;
+    }
+
+private:
+    struct entry_t
+    {
+        uint64_t key = 0;
+        uint32_t format = 0;
+        uint64_t used = 0;
+        frame_t frame;
+    };
+
+    mutable std::mutex mtx;
+    std::vector<entry_t> entries;
+    uint64_t clock = 0;
+    frame_cache_stats_t current;
+};
@@ -0,0 +1,571 @@
+#pragma once
+
+#include "ecosim.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+//Codec compacto de quadros da grade, sem dependencias externas. Um bloco
+//guarda um quadro inteiro (celulas em uma ordem fixa) ou as mudancas de um
+//quadro para o seguinte, em dois estagios:
+//
+//1. Modelo: no quadro, corridas de MIN_RUN ou mais celulas iguais (vazias,
+//   em geral) viram um par (literais antes, tamanho da corrida) no fluxo de
+//   controle, e as demais celulas vao como literais. Nas mudancas, o controle
+//   tem a distancia desde a ultima celula que mudou e a celula vai como a
+//   diferenca (bits novos - bits antigos, mod 2^32): um ser que so envelheceu
+//   da sempre a mesma diferenca. Cada celula (literal, da corrida ou
+//   diferenca) e separada em seus 4 bytes, um fluxo por byte, porque tipo,
+//   energia, idade e marcadores tem estatisticas bem diferentes.
+//2. Entropia: cada um dos 5 fluxos e gravado com um codigo de Huffman
+//   canonico proprio (ate MAX_CODE_BITS bits, decodificado por tabela), como
+//   um unico byte repetido ou sem codificacao, o que for menor.
+//
+//Formato: tipo (1 byte), numero de celulas ou de mudancas (varint) e os 5
+//fluxos; cada fluxo tem o modo (1 byte), o tamanho decodificado (varint) e os
+//dados do modo. Varints sao LEB128; bits sao lidos do menos significativo.
+namespace frame_codec
+{
+    const uint8_t FRAME = 1;
+    const uint8_t CHANGES = 2;
+
+    const uint8_t STORED = 0;
+    const uint8_t HUFFMAN = 1;
+    const uint8_t CONSTANT = 2;
+
+    const uint32_t MIN_RUN = 4;
+    const uint32_t MAX_CODE_BITS = 12;
+    const uint32_t STREAMS = 1 + sizeof(cell_t);
+
+    inline uint8_t *putVarint(uint8_t *out, uint64_t v)
+    {
+        while (v >= 0x80)
+        {
+            *out++ = (uint8_t)(v | 0x80);
+            v >>= 7;
+        }
+        *out++ = (uint8_t)v;
+        return out;
+    }
+
+    inline uint64_t getVarint(const uint8_t *&p, const uint8_t *end)
+    {
+        uint64_t v = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7)
+        {
+            uint8_t b = *p++;
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80)) return v;
+        }
+        throw std::runtime_error("corrupt varint");
+    }
+
+    inline size_t varintBytes(uint64_t v)
+    {
+        size_t n = 1;
+        for (; v >= 0x80; v >>= 7) n++;
+        return n;
+    }
+
+    //Codigo de Huffman canonico de um fluxo de bytes
+    struct huffman_code_t
+    {
+        uint8_t lengths[256];
+        //Codigos com os bits invertidos, prontos para o fluxo lido do bit menos significativo
+        uint16_t codes[256];
+
+        //Tamanhos otimos para as frequencias; se passam de MAX_CODE_BITS, as
+        //frequencias sao achatadas (divididas por 2) ate caber
+        void build(const uint64_t freq[256])
+        {
+            std::vector<uint64_t> f(freq, freq + 256);
+            while (true)
+            {
+                uint32_t longest = lengthsFor(f);
+                if (longest <= MAX_CODE_BITS) break;
+                for (uint64_t &x : f)
+                {
+                    if (x) x = (x + 1) / 2;
+                }
+            }
+            assign();
+        }
+
+        //Codigos canonicos a partir dos tamanhos: false se os tamanhos nao
+        //formam um codigo completo (bloco corrompido)
+        bool assign()
+        {
+            uint32_t count[MAX_CODE_BITS + 1] = {0};
+            uint64_t kraft = 0;
+            for (int s = 0; s < 256; s++)
+            {
+                if (lengths[s] > MAX_CODE_BITS) return false;
+                if (!lengths[s]) continue;
+                count[lengths[s]]++;
+                kraft += 1u << (MAX_CODE_BITS - lengths[s]);
+            }
+            uint32_t next[MAX_CODE_BITS + 2] = {0};
+            for (uint32_t len = 1; len <= MAX_CODE_BITS; len++) next[len + 1] = (next[len] + count[len]) << 1;
+            for (int s = 0; s < 256; s++)
+            {
+                uint32_t len = lengths[s];
+                codes[s] = 0;
+                if (!len) continue;
+                uint32_t code = next[len]++, reversed = 0;
+                for (uint32_t b = 0; b < len; b++) reversed |= ((code >> b) & 1) << (len - 1 - b);
+                codes[s] = (uint16_t)reversed;
+            }
+            return kraft == (1u << MAX_CODE_BITS);
+        }
+
+    private:
+        uint32_t lengthsFor(const std::vector<uint64_t> &f)
+        {
+            //Arvore de Huffman: folhas 0..255, nos internos a partir de 256
+            std::vector<int32_t> parent(512, -1);
+            typedef std::pair<uint64_t, int32_t> node_t;
+            std::priority_queue<node_t, std::vector<node_t>, std::greater<node_t>> heap;
+            for (int s = 0; s < 256; s++)
+            {
+                if (f[s]) heap.push({f[s], s});
+            }
+            int32_t next = 256;
+            while (heap.size() > 1)
+            {
+                node_t a = heap.top();
+                heap.pop();
+                node_t b = heap.top();
+                heap.pop();
+                parent[a.second] = parent[b.second] = next;
+                heap.push({a.first + b.first, next++});
+            }
+            uint32_t longest = 0;
+            for (int s = 0; s < 256; s++)
+            {
+                uint32_t depth = 0;
+                if (f[s])
+                {
+                    for (int32_t n = s; parent[n] >= 0; n = parent[n]) depth++;
+                }
+                lengths[s] = (uint8_t)std::min<uint32_t>(depth, 255);
+                longest = std::max(longest, depth);
+            }
+            return longest;
+        }
+    };
+
+    //Escreve codigos em little-endian, do bit menos significativo
+    struct bit_writer_t
+    {
+        uint8_t *out;
+        uint64_t acc = 0;
+        uint32_t fill = 0;
+
+        explicit bit_writer_t(uint8_t *o) : out(o) {}
+
+        void put(uint32_t code, uint32_t len)
+        {
+            acc |= (uint64_t)code << fill;
+            fill += len;
+            if (fill >= 32)
+            {
+                uint32_t word = (uint32_t)acc;
+                std::memcpy(out, &word, 4);
+                out += 4;
+                acc >>= 32;
+                fill -= 32;
+            }
+        }
+
+        uint8_t *finish()
+        {
+            for (; fill > 0; fill = fill > 8 ? fill - 8 : 0, acc >>= 8) *out++ = (uint8_t)acc;
+            return out;
+        }
+    };
+
+    //Monta blocos; os buffers sao reaproveitados entre blocos
+    class frame_encoder_t
+    {
+    public:
+        //Comeca um bloco de quadro inteiro: chamar add para cada celula, em ordem
+        void beginFrame(uint64_t cells)
+        {
+            begin(FRAME, cells);
+            run = 0;
+            literals = 0;
+        }
+
+        void add(cell_t c)
+        {
+            if (run && c.bits == run_cell.bits)
+            {
+                run++;
+                return;
+            }
+            flushRun();
+            run_cell = c;
+            run = 1;
+        }
+
+        //Comeca um bloco de ate maxChanges mudancas: chamar change em ordem
+        //crescente de indice
+        void beginChanges(uint64_t maxChanges)
+        {
+            begin(CHANGES, maxChanges);
+            next = 0;
+        }
+
+        void change(uint64_t index, cell_t now, cell_t before)
+        {
+            putControl(index - next);
+            pushCell(now.bits - before.bits);
+            next = index + 1;
+            count++;
+        }
+
+        //Anexa o bloco a out
+        void end(std::vector<uint8_t> &out)
+        {
+            if (kind == FRAME)
+            {
+                flushRun();
+                if (literals)
+                {
+                    putControl(literals);
+                    putControl(0);
+                }
+            }
+            size_t sizes[STREAMS], total = 1 + varintBytes(count);
+            for (uint32_t s = 0; s < STREAMS; s++)
+            {
+                sizes[s] = plan(s);
+                total += sizes[s];
+            }
+            size_t start = out.size();
+            out.resize(start + total);
+            uint8_t *p = out.data() + start;
+            *p++ = kind;
+            p = putVarint(p, count);
+            for (uint32_t s = 0; s < STREAMS; s++) p = write(s, p);
+        }
+
+    private:
+        void begin(uint8_t k, uint64_t cells)
+        {
+            kind = k;
+            count = k == FRAME ? cells : 0;
+            used[0] = 0;
+            for (uint32_t b = 0; b < sizeof(cell_t); b++)
+            {
+                if (streams[1 + b].size() < cells) streams[1 + b].resize(cells);
+                used[1 + b] = 0;
+            }
+        }
+
+        void putControl(uint64_t v)
+        {
+            std::vector<uint8_t> &c = streams[0];
+            if (c.size() < used[0] + 10) c.resize(std::max<size_t>(c.size() * 2, used[0] + 4096));
+            used[0] = putVarint(c.data() + used[0], v) - c.data();
+        }
+
+        void pushCell(uint32_t bits)
+        {
+            for (uint32_t b = 0; b < sizeof(cell_t); b++) streams[1 + b][used[1 + b]++] = (uint8_t)(bits >> (8 * b));
+        }
+
+        void flushRun()
+        {
+            if (run >= MIN_RUN)
+            {
+                putControl(literals);
+                putControl(run);
+                pushCell(run_cell.bits);
+                literals = 0;
+            }
+            else
+            {
+                for (uint64_t k = 0; k < run; k++) pushCell(run_cell.bits);
+                literals += run;
+            }
+            run = 0;
+        }
+
+        //Escolhe o modo do fluxo s e devolve quantos bytes ele ocupa
+        size_t plan(uint32_t s)
+        {
+            const uint8_t *data = streams[s].data();
+            size_t n = used[s];
+            uint64_t *freq = frequencies[s];
+            //Quatro histogramas intercalados, para nao serializar em bytes repetidos
+            uint32_t partial[4][256] = {{0}};
+            size_t k = 0;
+            for (; k + 4 <= n; k += 4)
+            {
+                partial[0][data[k]]++;
+                partial[1][data[k + 1]]++;
+                partial[2][data[k + 2]]++;
+                partial[3][data[k + 3]]++;
+            }
+            for (; k < n; k++) partial[0][data[k]]++;
+            for (int v = 0; v < 256; v++) freq[v] = (uint64_t)partial[0][v] + partial[1][v] + partial[2][v] + partial[3][v];
+            size_t head = 1 + varintBytes(n), symbols = 0;
+            for (int v = 0; v < 256; v++) symbols += freq[v] != 0;
+
+            mode[s] = STORED;
+            size_t best = n;
+            if (symbols == 1)
+            {
+                mode[s] = CONSTANT;
+                best = 1;
+            }
+            else if (symbols > 1)
+            {
+                huffman_code_t &code = codes[s];
+                code.build(freq);
+                uint64_t bits = 0;
+                for (int v = 0; v < 256; v++) bits += freq[v] * code.lengths[v];
+                coded[s] = (bits + 7) / 8;
+                size_t huffman = tableBytes(code, symbols) + varintBytes(coded[s]) + coded[s];
+                if (huffman < best)
+                {
+                    mode[s] = HUFFMAN;
+                    best = huffman;
+                }
+            }
+            return head + best;
+        }
+
+        //Tabela: numero de simbolos usados e, se sao poucos, pares (simbolo,
+        //tamanho); senao os 256 tamanhos, dois por byte
+        static size_t tableBytes(const huffman_code_t &, size_t symbols) { return varintBytes(symbols) + (symbols <= 96 ? 2 * symbols : 128); }
+
+        uint8_t *write(uint32_t s, uint8_t *p)
+        {
+            const uint8_t *data = streams[s].data();
+            size_t n = used[s];
+            *p++ = mode[s];
+            p = putVarint(p, n);
+            if (mode[s] == STORED)
+            {
+                if (n) std::memcpy(p, data, n);
+                return p + n;
+            }
+            if (mode[s] == CONSTANT)
+            {
+                *p++ = data[0];
+                return p;
+            }
+            const huffman_code_t &code = codes[s];
+            size_t symbols = 0;
+            for (int v = 0; v < 256; v++) symbols += code.lengths[v] != 0 && frequencies[s][v] != 0;
+            p = putVarint(p, symbols);
+            if (symbols <= 96)
+            {
+                for (int v = 0; v < 256; v++)
+                {
+                    if (!frequencies[s][v]) continue;
+                    *p++ = (uint8_t)v;
+                    *p++ = code.lengths[v];
+                }
+            }
+            else
+            {
+                for (int v = 0; v < 256; v += 2) *p++ = (uint8_t)(code.lengths[v] | (code.lengths[v + 1] << 4));
+            }
+            p = putVarint(p, coded[s]);
+            uint32_t entry[256];
+            for (int v = 0; v < 256; v++) entry[v] = code.codes[v] | ((uint32_t)code.lengths[v] << 16);
+            bit_writer_t bits(p);
+            for (size_t k = 0; k < n; k++) bits.put(entry[data[k]] & 0xFFFF, entry[data[k]] >> 16);
+            return bits.finish();
+        }
+
+        uint8_t kind = FRAME;
+        uint64_t count = 0;
+        std::vector<uint8_t> streams[STREAMS];
+        size_t used[STREAMS] = {0};
+        uint64_t frequencies[STREAMS][256];
+        huffman_code_t codes[STREAMS];
+        uint8_t mode[STREAMS] = {0};
+        uint64_t coded[STREAMS] = {0};
+
+        //Corrida em andamento e literais desde a ultima corrida (quadro)
+        cell_t run_cell = EMPTY_CELL;
+        uint64_t run = 0;
+        uint64_t literals = 0;
+        //Indice seguinte a ultima mudanca (mudancas)
+        uint64_t next = 0;
+    };
+
+    //Le blocos; os buffers sao reaproveitados entre blocos
+    class frame_decoder_t
+    {
+    public:
+        //Tipo do bloco (FRAME ou CHANGES)
+        static uint8_t kindOf(const uint8_t *in, size_t bytes)
+        {
+            if (!bytes || (in[0] != FRAME && in[0] != CHANGES)) throw std::runtime_error("corrupt frame block");
+            return in[0];
+        }
+
+        //Quadro de `cells` celulas: put(celula) e chamado para cada uma, em ordem
+        template <class F>
+        void frame(const uint8_t *in, size_t bytes, uint64_t cells, F &&put)
+        {
+            if (kindOf(in, bytes) != FRAME) throw std::runtime_error("corrupt frame block");
+            const uint8_t *p = in + 1, *end = in + bytes;
+            if (getVarint(p, end) != cells) throw std::runtime_error("frame block has the wrong number of cells");
+            streams(p, end);
+            const uint8_t *c = data[0].data(), *cend = c + data[0].size();
+            size_t k = 0, planeCells = data[1].size();
+            uint64_t done = 0;
+            auto take = [&]() {
+                if (k >= planeCells) throw std::runtime_error("corrupt frame block");
+                return cell(k++);
+            };
+            while (done < cells)
+            {
+                uint64_t literals = getVarint(c, cend), run = getVarint(c, cend);
+                if (!(literals | run) || literals > cells - done || run > cells - done - literals) throw std::runtime_error("corrupt frame block");
+                for (uint64_t n = 0; n < literals; n++) put(take());
+                if (run)
+                {
+                    cell_t v = take();
+                    for (uint64_t n = 0; n < run; n++) put(v);
+                }
+                done += literals + run;
+            }
+        }
+
+        //Mudancas para um quadro de `cells` celulas: cellAt(indice) devolve a
+        //celula (referencia) a atualizar
+        template <class F>
+        void changes(const uint8_t *in, size_t bytes, uint64_t cells, F &&cellAt)
+        {
+            if (kindOf(in, bytes) != CHANGES) throw std::runtime_error("corrupt frame block");
+            const uint8_t *p = in + 1, *end = in + bytes;
+            uint64_t n = getVarint(p, end);
+            streams(p, end);
+            if (n != data[1].size()) throw std::runtime_error("corrupt frame block");
+            const uint8_t *c = data[0].data(), *cend = c + data[0].size();
+            uint64_t index = 0;
+            for (size_t k = 0; k < n; k++)
+            {
+                index += getVarint(c, cend);
+                if (index >= cells) throw std::runtime_error("corrupt frame block");
+                cell_t &target = cellAt(index);
+                target.bits += cell(k).bits;
+                index++;
+            }
+        }
+
+    private:
+        cell_t cell(size_t k) const
+        {
+            return {(uint32_t)data[1][k] | ((uint32_t)data[2][k] << 8) | ((uint32_t)data[3][k] << 16) | ((uint32_t)data[4][k] << 24)};
+        }
+
+        void streams(const uint8_t *&p, const uint8_t *end)
+        {
+            for (uint32_t s = 0; s < STREAMS; s++) stream(p, end, data[s]);
+            if (p != end) throw std::runtime_error("corrupt frame block");
+            for (uint32_t b = 2; b < STREAMS; b++)
+            {
+                if (data[b].size() != data[1].size()) throw std::runtime_error("corrupt frame block");
+            }
+        }
+
+        void stream(const uint8_t *&p, const uint8_t *end, std::vector<uint8_t> &out)
+        {
+            if (p >= end) throw std::runtime_error("corrupt frame block");
+            uint8_t mode = *p++;
+            uint64_t n = getVarint(p, end);
+            if (mode == STORED)
+            {
+                if ((uint64_t)(end - p) < n) throw std::runtime_error("corrupt frame block");
+                out.assign(p, p + n);
+                p += n;
+                return;
+            }
+            if (mode == CONSTANT)
+            {
+                if (p >= end) throw std::runtime_error("corrupt frame block");
+                out.assign(n, *p++);
+                return;
+            }
+            if (mode != HUFFMAN) throw std::runtime_error("corrupt frame block");
+
+            huffman_code_t code;
+            std::fill(code.lengths, code.lengths + 256, 0);
+            uint64_t symbols = getVarint(p, end);
+            if (symbols < 2 || symbols > 256) throw std::runtime_error("corrupt frame block");
+            if (symbols <= 96)
+            {
+                if ((uint64_t)(end - p) < 2 * symbols) throw std::runtime_error("corrupt frame block");
+                for (uint64_t k = 0; k < symbols; k++, p += 2) code.lengths[p[0]] = p[1];
+            }
+            else
+            {
+                if (end - p < 128) throw std::runtime_error("corrupt frame block");
+                for (int v = 0; v < 256; v += 2, p++)
+                {
+                    code.lengths[v] = *p & 15;
+                    code.lengths[v + 1] = *p >> 4;
+                }
+            }
+            if (!code.assign()) throw std::runtime_error("corrupt frame block");
+            table.resize(1u << MAX_CODE_BITS);
+            for (int v = 0; v < 256; v++)
+            {
+                uint32_t len = code.lengths[v];
+                if (!len) continue;
+                for (uint32_t r = code.codes[v]; r < (1u << MAX_CODE_BITS); r += 1u << len) table[r] = (uint16_t)(v | (len << 8));
+            }
+
+            uint64_t bytes = getVarint(p, end);
+            if ((uint64_t)(end - p) < bytes || n > bytes * 8) throw std::runtime_error("corrupt frame block");
+            const uint8_t *in = p, *inEnd = p + bytes;
+            out.resize(n);
+            uint64_t acc = 0;
+            uint32_t bits = 0;
+            uint64_t consumed = 0;
+            for (uint64_t k = 0; k < n;)
+            {
+                //Completa o acumulador: 8 bytes de uma vez longe do fim, senao byte a byte (zeros depois do fim)
+                if (inEnd - in >= 8)
+                {
+                    uint64_t word;
+                    std::memcpy(&word, in, 8);
+                    acc |= word << bits;
+                    in += (63 - bits) >> 3;
+                    bits |= 56;
+                }
+                else
+                {
+                    for (; bits <= 56; bits += 8) acc |= (uint64_t)(in < inEnd ? *in++ : 0) << bits;
+                }
+                for (uint64_t stop = std::min<uint64_t>(n, k + 4); k < stop; k++)
+                {
+                    uint16_t e = table[acc & ((1u << MAX_CODE_BITS) - 1)];
+                    uint32_t len = e >> 8;
+                    out[k] = (uint8_t)e;
+                    acc >>= len;
+                    bits -= len;
+                    consumed += len;
+                }
+            }
+            if (consumed > bytes * 8) throw std::runtime_error("corrupt frame block");
+            p += bytes;
+        }
+
+        std::vector<uint8_t> data[STREAMS];
+        std::vector<uint16_t> table;
+    };
+}
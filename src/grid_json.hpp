@@ -0,0 +1,175 @@
+#pragma once
+
+#include "ecosim.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+//Grade em JSON escrita direto em um buffer, sem montar a arvore do nlohmann:
+//o mesmo texto de gridToJson(w).dump() (uma lista por linha, um objeto por
+//celula com as chaves em ordem alfabetica), byte a byte. Os pedacos fixos de
+//cada objeto e os numeros de 0 a 255 (a idade e, fora das regras originais, a
+//energia) ficam prontos em tabelas; a celula vazia, a mais comum, e um unico
+//memcpy.
+//
+//writeRows escreve a forma compacta (format=rows): uma string de tipos por
+//linha e, so para as celulas ocupadas, em ordem linha a linha, a energia e a
+//idade em listas paralelas:
+//{"rows":R,"cols":C,"types":["P H ",...],"energy":[...],"age":[...]}
+namespace grid_json
+{
+    //Cada celula e {"age":A,"energy":E,"type":"T"}: 29 bytes mais os digitos
+    //(ate 3 da idade e 5 da energia, que pode ser negativa)
+    const size_t CELL_FIXED_BYTES = 29;
+    const size_t CELL_MAX_BYTES = CELL_FIXED_BYTES + 8;
+
+    struct fragments_t
+    {
+        //Digitos de n, com folga para copiar sempre 4 bytes
+        char digits[256][4];
+        uint8_t digit_count[256];
+        //Fim do objeto por tipo: ,"type":"T"}
+        char tail[4][12];
+        char type_char[4];
+        char empty_cell[CELL_FIXED_BYTES + 2];
+
+        fragments_t()
+        {
+            for (int n = 0; n < 256; n++)
+            {
+                std::string text = std::to_string(n);
+                std::memset(digits[n], 0, 4);
+                std::memcpy(digits[n], text.data(), text.size());
+                digit_count[n] = (uint8_t)text.size();
+            }
+            const char types[4] = {' ', 'P', 'H', 'C'};
+            std::memcpy(type_char, types, 4);
+            for (int t = 0; t < 4; t++)
+            {
+                std::memcpy(tail[t], ",\"type\":\"", 9);
+                tail[t][9] = types[t];
+                tail[t][10] = '"';
+                tail[t][11] = '}';
+            }
+            std::memcpy(empty_cell, "{\"age\":0,\"energy\":0,\"type\":\" \"}", CELL_FIXED_BYTES + 2);
+        }
+    };
+
+    inline const fragments_t &fragments()
+    {
+        static const fragments_t f;
+        return f;
+    }
+
+    //Escreve n: pela tabela se esta em [0, 255], senao por snprintf
+    inline char *writeNumber(char *p, int32_t n, const fragments_t &f)
+    {
+        if ((uint32_t)n <= CELL_FIELD_MASK)
+        {
+            std::memcpy(p, f.digits[n], 4);
+            return p + f.digit_count[n];
+        }
+        return p + std::snprintf(p, 8, "%d", (int)n);
+    }
+
+    inline char *writeCell(char *p, cell_t c, const fragments_t &f)
+    {
+        if (c.bits == EMPTY_CELL.bits)
+        {
+            std::memcpy(p, f.empty_cell, CELL_FIXED_BYTES + 2);
+            return p + CELL_FIXED_BYTES + 2;
+        }
+        uint32_t age = (uint32_t)cellAge(c);
+        std::memcpy(p, "{\"age\":", 7);
+        p += 7;
+        std::memcpy(p, f.digits[age], 4);
+        p += f.digit_count[age];
+        std::memcpy(p, ",\"energy\":", 10);
+        p = writeNumber(p + 10, cellEnergy(c), f);
+        std::memcpy(p, f.tail[cellType(c)], 12);
+        return p + 12;
+    }
+
+    //Escreve a grade de w em out (a capacidade de out e reaproveitada)
+    inline void write(const world_t &w, std::string &out)
+    {
+        const fragments_t &f = fragments();
+        out.resize(2 + (size_t)w.rows * (3 + (size_t)w.cols * (CELL_MAX_BYTES + 1)));
+        char *begin = &out[0], *p = begin;
+        *p++ = '[';
+        for (uint32_t i = 0; i < w.rows; i++)
+        {
+            if (i) *p++ = ',';
+            *p++ = '[';
+            const cell_t *row = w.entity_grid.data() + w.row_base[i];
+            for (uint32_t j = 0; j < w.cols; j++)
+            {
+                if (j) *p++ = ',';
+                p = writeCell(p, row[w.col_base[j]], f);
+            }
+            *p++ = ']';
+        }
+        *p++ = ']';
+        out.resize(p - begin);
+    }
+
+    inline std::string write(const world_t &w)
+    {
+        std::string out;
+        write(w, out);
+        return out;
+    }
+
+    //Escreve a forma compacta da grade de w em out
+    inline void writeRows(const world_t &w, std::string &out)
+    {
+        const fragments_t &f = fragments();
+        size_t occupied = 0;
+        for (uint32_t i = 0; i < w.rows; i++)
+        {
+            const cell_t *row = w.entity_grid.data() + w.row_base[i];
+            for (uint32_t j = 0; j < w.cols; j++) occupied += cellType(row[w.col_base[j]]) != empty;
+        }
+        out.resize(96 + (size_t)w.rows * (w.cols + 3) + occupied * 10);
+        char *begin = &out[0], *p = begin;
+        p += std::snprintf(p, 64, "{\"rows\":%u,\"cols\":%u,\"types\":[", w.rows, w.cols);
+        for (uint32_t i = 0; i < w.rows; i++)
+        {
+            if (i) *p++ = ',';
+            *p++ = '"';
+            const cell_t *row = w.entity_grid.data() + w.row_base[i];
+            for (uint32_t j = 0; j < w.cols; j++) *p++ = f.type_char[cellType(row[w.col_base[j]])];
+            *p++ = '"';
+        }
+        //Energia e depois idade: duas passadas sobre as celulas ocupadas
+        for (int field = 0; field < 2; field++)
+        {
+            std::memcpy(p, field ? "],\"age\":[" : "],\"energy\":[", field ? 9 : 12);
+            p += field ? 9 : 12;
+            bool first = true;
+            for (uint32_t i = 0; i < w.rows; i++)
+            {
+                const cell_t *row = w.entity_grid.data() + w.row_base[i];
+                for (uint32_t j = 0; j < w.cols; j++)
+                {
+                    cell_t c = row[w.col_base[j]];
+                    if (cellType(c) == empty) continue;
+                    if (!first) *p++ = ',';
+                    first = false;
+                    p = writeNumber(p, field ? cellAge(c) : cellEnergy(c), f);
+                }
+            }
+        }
+        *p++ = ']';
+        *p++ = '}';
+        out.resize(p - begin);
+    }
+
+    inline std::string writeRows(const world_t &w)
+    {
+        std::string out;
+        writeRows(w, out);
+        return out;
+    }
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+//Memoria das grades do mundo. Buffers grandes (a partir de uma pagina enorme)
+//vem direto de mmap: as paginas so sao alocadas no primeiro toque, entao quem
+//inicializa cada faixa decide em que no NUMA ela fica. Opcionalmente o buffer
+//usa paginas enormes, transparentes (madvise) ou explicitas (hugetlbfs).
+namespace grid_memory
+{
+    enum huge_pages_t
+    {
+        huge_off,
+        huge_transparent,
+        huge_explicit
+    };
+
+    //Tamanho de uma pagina enorme (x86-64) e limite a partir do qual usa mmap
+    const size_t HUGE_PAGE_BYTES = 2u << 20;
+
+    //Politica aplicada as proximas alocacoes
+    inline std::atomic<huge_pages_t> &policy()
+    {
+        static std::atomic<huge_pages_t> current{huge_off};
+        return current;
+    }
+
+    //Bytes mapeados em cada modo, para relatorio
+    struct usage_t
+    {
+        std::atomic<uint64_t> mapped{0};
+        std::atomic<uint64_t> transparent{0};
+        std::atomic<uint64_t> explicit_pages{0};
+        std::atomic<uint64_t> explicit_fallbacks{0};
+    };
+
+    inline usage_t &usage()
+    {
+        static usage_t u;
+        return u;
+    }
+
+    inline size_t roundUp(size_t bytes) { return (bytes + HUGE_PAGE_BYTES - 1) & ~(HUGE_PAGE_BYTES - 1); }
+
+    inline void *map(size_t bytes)
+    {
+        size_t size = roundUp(bytes);
+        huge_pages_t mode = policy().load();
+        if (mode == huge_explicit)
+        {
+            void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED)
+            {
+                usage().mapped += size;
+                usage().explicit_pages += size;
+                return p;
+            }
+            //Sem paginas reservadas em hugetlbfs: cai para as transparentes
+            usage().explicit_fallbacks++;
+            mode = huge_transparent;
+        }
+
+        void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) throw std::bad_alloc();
+        usage().mapped += size;
+        if (mode == huge_transparent && ::madvise(p, size, MADV_HUGEPAGE) == 0) usage().transparent += size;
+        return p;
+    }
+
+    inline void unmap(void *p, size_t bytes)
+    {
+        ::munmap(p, roundUp(bytes));
+        usage().mapped -= roundUp(bytes);
+    }
+}
+
+//Alocador das grades: buffers grandes via grid_memory::map, pequenos pelo
+//heap. A construcao padrao nao escreve nada (as celulas sao triviais), para
+//que o primeiro toque fique com quem inicializa a grade.
+//
+//Com uma regiao (memoria que pertence a outro dono, como um arquivo mapeado),
+//allocate devolve a propria regiao e deallocate nao a libera: um vetor criado
+//com esse alocador passa a ver os dados que ja estao la. O alocador acompanha o
+//vetor na troca e na movimentacao; copias do vetor voltam para a memoria normal.
+template <class T>
+struct grid_allocator_t
+{
+    static_assert(std::is_trivially_default_constructible<T>::value, "grid cells must be trivial");
+    using value_type = T;
+    using propagate_on_container_swap = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using is_always_equal = std::false_type;
+
+    void *region = nullptr;
+    size_t region_bytes = 0;
+
+    grid_allocator_t() = default;
+    grid_allocator_t(void *r, size_t bytes) : region(r), region_bytes(bytes) {}
+    template <class U>
+    grid_allocator_t(const grid_allocator_t<U> &o) : region(o.region), region_bytes(o.region_bytes) {}
+
+    grid_allocator_t select_on_container_copy_construction() const { return grid_allocator_t(); }
+
+    T *allocate(size_t n)
+    {
+        size_t bytes = n * sizeof(T);
+        if (region && bytes <= region_bytes) return static_cast<T *>(region);
+        if (bytes >= grid_memory::HUGE_PAGE_BYTES) return static_cast<T *>(grid_memory::map(bytes));
+        return static_cast<T *>(::operator new(bytes));
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        size_t bytes = n * sizeof(T);
+        if (p == region) return;
+        if (bytes >= grid_memory::HUGE_PAGE_BYTES)
+            grid_memory::unmap(p, bytes);
+        else
+            ::operator delete(p);
+    }
+
+    template <class U>
+    void construct(U *p)
+    {
+        ::new ((void *)p) U;
+    }
+
+    template <class U, class... Args>
+    void construct(U *p, Args &&...args)
+    {
+        ::new ((void *)p) U(std::forward<Args>(args)...);
+    }
+
+    template <class U>
+    bool operator==(const grid_allocator_t<U> &o) const { return region == o.region; }
+    template <class U>
+    bool operator!=(const grid_allocator_t<U> &o) const { return region != o.region; }
+};
+
+template <class T>
+using grid_vector_t = std::vector<T, grid_allocator_t<T>>;
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#ifdef ECOSIM_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+//Codificacao de conteudo das respostas HTTP (Content-Encoding), com zlib quando
+//o programa e compilado com ela. Os quadros sao comprimidos uma vez por estado
+//e formato e guardados no cache de quadros, como os demais.
+namespace http_compression
+{
+    enum encoding_t
+    {
+        identity,
+        gzip,
+        deflate
+    };
+
+    const uint32_t ENCODINGS = 3;
+
+    //Corpos menores que isso vao sem compressao
+    const size_t MIN_BYTES = 1024;
+
+    inline bool available()
+    {
+#ifdef ECOSIM_HAVE_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    inline const char *name(encoding_t e) { return e == gzip ? "gzip" : e == deflate ? "deflate" : "identity"; }
+
+    //Melhor codificacao aceita pelo cliente (Accept-Encoding): gzip, depois
+    //deflate; q=0 recusa a codificacao. "*" vale so para as codificacoes que
+    //o cabecalho nao cita pelo nome, entao "gzip;q=0, *" nao escolhe gzip.
+    inline encoding_t accepted(const std::string &header)
+    {
+        if (!available()) return identity;
+        //-1: nao citada; 0: recusada; 1: aceita
+        int gz = -1, df = -1, any = -1;
+        size_t at = 0;
+        while (at < header.size())
+        {
+            size_t end = header.find(',', at);
+            if (end == std::string::npos) end = header.size();
+            std::string item = header.substr(at, end - at);
+            at = end + 1;
+
+            size_t semicolon = item.find(';');
+            std::string token = item.substr(0, semicolon), params = semicolon == std::string::npos ? "" : item.substr(semicolon + 1);
+            std::string clean;
+            for (char c : token)
+            {
+                if (!std::isspace((unsigned char)c)) clean += (char)std::tolower((unsigned char)c);
+            }
+            std::string q;
+            for (char c : params)
+            {
+                if (!std::isspace((unsigned char)c)) q += c;
+            }
+            int state = q.compare(0, 2, "q=") == 0 && std::strtod(q.c_str() + 2, nullptr) <= 0 ? 0 : 1;
+            //Se a mesma codificacao aparece mais de uma vez, uma recusa prevalece
+            int *slot = clean == "gzip" || clean == "x-gzip" ? &gz : clean == "deflate" ? &df : clean == "*" ? &any : nullptr;
+            if (slot) *slot = *slot == 0 ? 0 : state;
+        }
+        if (gz < 0) gz = any;
+        if (df < 0) df = any;
+        return gz > 0 ? gzip : df > 0 ? deflate : identity;
+    }
+
+    //Comprime body no nivel dado (1 a 9): gzip ou deflate no formato zlib, que
+    //e o que "deflate" significa em HTTP
+    inline std::string compress(const std::string &body, encoding_t e, int level)
+    {
+#ifdef ECOSIM_HAVE_ZLIB
+        z_stream z{};
+        if (deflateInit2(&z, level, Z_DEFLATED, e == gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+            throw std::runtime_error("deflateInit2 failed");
+        std::string out(deflateBound(&z, (uLong)body.size()), '\0');
+        z.next_in = (Bytef *)body.data();
+        z.avail_in = (uInt)body.size();
+        z.next_out = (Bytef *)&out[0];
+        z.avail_out = (uInt)out.size();
+        int status = ::deflate(&z, Z_FINISH);
+        out.resize(z.total_out);
+        deflateEnd(&z);
+        if (status != Z_STREAM_END) throw std::runtime_error("deflate failed");
+        return out;
+#else
+        (void)e;
+        (void)level;
+        return body;
+#endif
+    }
+}
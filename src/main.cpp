@@ -0,0 +1,1261 @@
+#define CROW_MAIN
+#define CROW_STATIC_DIR "../public"
+
+#include "crow_all.h"
+#include "json.hpp"
+#include "ecosim.hpp"
+#include "sweep.hpp"
+#include "distributed.hpp"
+#include "tiled.hpp"
+#include "active.hpp"
+#include "parallel.hpp"
+#include "determinism.hpp"
+#include "pacer.hpp"
+#include "density.hpp"
+#include "mapped_world.hpp"
+#include "world_file.hpp"
+#include "checkpoint_writer.hpp"
+#include "trajectory.hpp"
+#include "frame_codec.hpp"
+#include "grid_json.hpp"
+#include "frame_cache.hpp"
+#include "http_compression.hpp"
+#include "replay.hpp"
+#include "alloc_counter.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+// Auxiliary code to convert the entity_type_t enum to a string
+NLOHMANN_JSON_SERIALIZE_ENUM(entity_type_t, {
+                                                {empty, " "},
+                                                {plant, "P"},
+                                                {herbivore, "H"},
+                                                {carnivore, "C"},
+                                            })
+
+// Auxiliary code to convert the entity_t struct to a JSON object
+namespace nlohmann
+{
+    void to_json(nlohmann::json &j, const entity_t &e)
+    {
+        j = nlohmann::json{{"type", e.type}, {"energy", e.energy}, {"age", e.age}};
+    }
+}
+
+// World that contains the entities
+static world_t world(NUM_ROWS, NUM_ROWS);
+
+// Partitioned engine when running with --distributed or --tiled (otherwise null)
+static std::unique_ptr<partitioned_engine_t> engine;
+
+// Chooses between the serial and the parallel tick of the claim rules when there is no
+// partitioned engine (null with the original rules, which tick in place on one thread)
+static std::unique_ptr<adaptive_ticker_t> ticker;
+
+// Sparse tick over sorted live-entity lists when running with --active-lists (otherwise null)
+static std::unique_ptr<active_ticker_t> active;
+
+// Stable entity identities when running with --track (otherwise null)
+static std::unique_ptr<entity_tracker_t> tracker;
+
+// File-backed grid when running with --world-file (otherwise null)
+static std::unique_ptr<mapped_world_t> store;
+
+// Directory of the checkpoints named in /checkpoint and /restore (--checkpoint-dir)
+static std::string checkpoint_dir = ".";
+
+// Background checkpoints (POST /checkpoint and --checkpoint-every)
+static checkpoint_writer_t checkpointer;
+
+// Ticks between automatic checkpoints to autosave.ckpt in checkpoint_dir (0 = off)
+static uint64_t checkpoint_every = 0;
+
+// Trajectory of the current simulation when running with --record PATH (restarted by
+// /start-simulation and /restore), with a keyframe every --keyframe-every ticks and
+// records compressed by the frame codec with --record-packed
+static trajectory_recorder_t recorder;
+static std::string record_path;
+static uint32_t keyframe_every = 100;
+static bool record_packed = false;
+
+// Seed fixed with --seed (otherwise each simulation draws a new one)
+static std::unique_ptr<uint64_t> fixed_seed;
+
+// Guards the world and the engines (the paced loop runs in its own thread)
+static std::mutex world_mutex;
+
+// Frames already serialized for the current state of the world, once per format and encoding
+// and shared by all requests; world_version changes whenever the world does (ticks, resets, restores)
+static frame_cache_t frames(6 * http_compression::ENCODINGS);
+static std::atomic<uint64_t> world_version{0};
+
+// Variants (format * ENCODINGS + encoding) asked for since the last paced tick, published with it
+static std::atomic<uint32_t> wanted_variants{0};
+
+// zlib level of the gzip/deflate responses (--compression-level, 1 to 9; 0 = always identity)
+static int compression_level = 6;
+
+// The HTML page, read again when it changes on disk, once per encoding
+static frame_cache_t pages(2 * http_compression::ENCODINGS);
+
+// Server-side real-time loop (--tick-rate or POST /pace)
+static std::unique_ptr<pacer_t> pacer;
+
+// Per-species count pyramid served by /density, refreshed from the dirty tiles on each request
+static density_pyramid_t density;
+
+// The partitioned engine advanced past the last gathered frame
+static bool world_stale = false;
+
+//Converte a grade em uma matriz JSON (uma lista por linha). Os quadros sao
+//escritos por grid_json::write; esta versao fica como referencia do formato
+nlohmann::json gridToJson(const world_t &w)
+{
+    nlohmann::json json_grid = nlohmann::json::array();
+    for (uint32_t i = 0; i < w.rows; i++)
+    {
+        nlohmann::json row = nlohmann::json::array();
+        for (uint32_t j = 0; j < w.cols; j++) row.push_back(unpackCell(w.at(i, j)));
+        json_grid.push_back(std::move(row));
+    }
+    return json_grid;
+}
+
+//O JSON de grid_json::write e identico ao de gridToJson? Confere o mundo do
+//caso de determinismo nos dois layouts e um mundo com todas as combinacoes de
+//tipo, energia e idade (com marcadores, que nao aparecem no JSON)
+bool checkFrameJson(std::ostream &out)
+{
+    determinism_case_t c;
+    bool same = true;
+    for (grid_layout_t layout : {layout_row_major, layout_morton})
+    {
+        world_t w;
+        w.layout = layout;
+        w.resize(c.rows, c.cols);
+        w.reset(c.seed);
+        startEcoSim(w, c.plants, c.herbivores, c.carnivores);
+        for (uint32_t t = 0; t < 20; t++) nextIteration(w);
+        same &= grid_json::write(w) == gridToJson(w).dump();
+    }
+    world_t all(512, 512);
+    for (uint32_t k = 0; k < 512 * 512; k++)
+    {
+        entity_t e{(entity_type_t)(k >> 16), (int32_t)((k >> 8) & 255), (int32_t)(k & 255)};
+        all.at(k / 512, k % 512) = withFlags(packCell(e), k * 2654435761u);
+    }
+    same &= grid_json::write(all) == gridToJson(all).dump();
+    //Energias das regras originais: negativas e acima de 255
+    world_t wide(64, 64);
+    for (uint32_t k = 0; k < 64 * 64; k++)
+    {
+        entity_t e{(entity_type_t)(1 + k % 3), CELL_MIN_ENERGY + (int32_t)k, (int32_t)(k % 256)};
+        wide.at(k / 64, k % 64) = withFlags(packCell(e), k);
+        same &= cellEnergy(wide.at(k / 64, k % 64)) == e.energy && cellAge(wide.at(k / 64, k % 64)) == e.age;
+    }
+    same &= grid_json::write(wide) == gridToJson(wide).dump();
+    out << "frame json: " << (same ? "ok" : "MISMATCH") << "\n";
+    return same;
+}
+
+//Converte a grade em um bloco do codec de quadros (celulas linha a linha), para
+//clientes que pedem format=packed
+std::string gridToPacked(const world_t &w)
+{
+    //Cada thread do servidor reaproveita os buffers do seu codificador
+    static thread_local frame_codec::frame_encoder_t encoder;
+    static thread_local std::vector<uint8_t> block;
+    block.clear();
+    encoder.beginFrame((uint64_t)w.rows * w.cols);
+    for (uint32_t i = 0; i < w.rows; i++)
+    {
+        for (uint32_t j = 0; j < w.cols; j++) encoder.add(w.at(i, j));
+    }
+    encoder.end(block);
+    return std::string(block.begin(), block.end());
+}
+
+//Formatos de quadro: cells (um objeto por celula), rows (uma string de tipos
+//por linha, ver grid_json.hpp) e packed (bloco do codec de quadros)
+enum frame_format_t
+{
+    format_cells,
+    format_rows,
+    format_packed
+};
+
+//Parametro inteiro ?name= da URL (fallback se ausente); invalid_argument se
+//nao e um inteiro de 0 a UINT32_MAX
+uint32_t uintParam(const crow::request &req, const char *name, uint32_t fallback)
+{
+    const char *v = req.url_params.get(name);
+    if (!v) return fallback;
+    char *end = nullptr;
+    errno = 0;
+    unsigned long long n = std::isdigit((unsigned char)v[0]) ? std::strtoull(v, &end, 10) : 0;
+    if (!end || *end || errno == ERANGE || n > UINT32_MAX)
+        throw std::invalid_argument(std::string(name) + " must be an integer from 0 to " + std::to_string(UINT32_MAX));
+    return (uint32_t)n;
+}
+
+//Formato pedido em ?format= (cells se ausente)
+frame_format_t frameFormat(const crow::request &req)
+{
+    const char *format = req.url_params.get("format");
+    std::string name = format ? format : "cells";
+    if (name == "cells") return format_cells;
+    if (name == "rows") return format_rows;
+    if (name == "packed") return format_packed;
+    throw std::invalid_argument("unknown frame format: " + name);
+}
+
+std::string renderFormat(frame_format_t format, const world_t &w)
+{
+    if (format == format_cells) return grid_json::write(w);
+    if (format == format_rows) return grid_json::writeRows(w);
+    return gridToPacked(w);
+}
+
+//Quadro pronto para responder: o corpo e a codificacao em que ele esta
+struct encoded_frame_t
+{
+    frame_cache_t::frame_t body;
+    http_compression::encoding_t encoding;
+};
+
+//Codificacao da resposta: a melhor aceita pelo cliente, se a compressao esta ligada
+http_compression::encoding_t responseEncoding(const crow::request &req)
+{
+    if (!compression_level) return http_compression::identity;
+    return http_compression::accepted(req.get_header_value("Accept-Encoding"));
+}
+
+//Como responseEncoding, mas o formato packed ja sai do codec de quadros e vai sem compressao
+http_compression::encoding_t frameEncoding(const crow::request &req, frame_format_t format)
+{
+    return format == format_packed ? http_compression::identity : responseEncoding(req);
+}
+
+//Variante de plain (o corpo guardado em (key, slot * ENCODINGS) de cache) na
+//codificacao pedida: comprimida uma vez e guardada no mesmo cache, ao lado do
+//original. Corpos pequenos vao sem compressao
+encoded_frame_t encodeFrame(frame_cache_t &cache, uint64_t key, uint32_t slot, const frame_cache_t::frame_t &plain,
+                            http_compression::encoding_t encoding)
+{
+    if (encoding == http_compression::identity || plain->size() < http_compression::MIN_BYTES) return {plain, http_compression::identity};
+    return {cache.get(key, slot * http_compression::ENCODINGS + encoding, [&] { return http_compression::compress(*plain, encoding, compression_level); }),
+            encoding};
+}
+
+//Cabecalhos de uma resposta que pode ou nao estar comprimida
+void setEncoding(crow::response &res, http_compression::encoding_t encoding)
+{
+    if (encoding != http_compression::identity) res.set_header("Content-Encoding", http_compression::name(encoding));
+    if (compression_level) res.set_header("Vary", "Accept-Encoding");
+}
+
+//Resposta com um quadro serializado (o corpo e copiado do quadro compartilhado)
+crow::response frameResponse(frame_format_t format, const encoded_frame_t &frame)
+{
+    crow::response res(*frame.body);
+    if (format == format_packed) res.set_header("Content-Type", "application/octet-stream");
+    else setEncoding(res, frame.encoding);
+    return res;
+}
+
+//Serve public/index.html (relativo ao diretorio de trabalho, como CROW_STATIC_DIR),
+//lido de novo so quando o arquivo muda
+void pageResponse(const crow::request &req, crow::response &res)
+{
+    const char *path = CROW_STATIC_DIR "/index.html";
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        res.code = 404;
+        res.end();
+        return;
+    }
+    uint64_t version = (uint64_t)st.st_mtim.tv_sec * 1000000000u + (uint64_t)st.st_mtim.tv_nsec;
+    frame_cache_t::frame_t plain = pages.get(version, 0, [path] {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    });
+    encoded_frame_t page = encodeFrame(pages, version, 0, plain, responseEncoding(req));
+    res.body = *page.body;
+    res.set_header("Content-Type", "text/html");
+    setEncoding(res, page.encoding);
+    res.end();
+}
+
+//Monta o mundo a partir do motor particionado, se ele avancou desde o ultimo
+//quadro (chamar com world_mutex travado)
+void syncWorld()
+{
+    if (!engine || !world_stale) return;
+    checkpointer.settle();
+    engine->gather(world);
+    world_stale = false;
+}
+
+//Para a piramide de densidade basta a especie de cada celula: com um motor
+//particionado, so os ladrilhos que mudaram vem dos subdominios, e o mundo
+//continua atrasado (energia e idade) para os quadros e checkpoints
+void syncSpecies()
+{
+    if (!engine || !world_stale) return;
+    checkpointer.settle();
+    engine->gatherSpecies(world);
+}
+
+//Avanca um tick no motor em uso; o mundo so e montado ao gerar um quadro ou
+//um checkpoint
+void advance()
+{
+    if (engine)
+    {
+        world.tick = engine->step(1);
+        world_stale = true;
+    }
+    else
+    {
+        checkpointer.beforeTick(world);
+        if (store)
+            nextIterationWavefront(world, store.get());
+        else if (active)
+            active->step(world, tracker.get());
+        else if (ticker)
+            ticker->step(world, tracker.get());
+        else
+        {
+            //As regras originais escrevem na propria grade, que pode ser a de
+            //um checkpoint em andamento: cada pedaco e copiado quando a
+            //varredura chega nele
+            nextIterationOriginal(world, [](uint32_t row) { checkpointer.beforeRow(world, row); });
+        }
+    }
+    if (recorder.recording())
+    {
+        syncWorld();
+        recorder.push(world);
+    }
+    if (checkpoint_every && world.tick % checkpoint_every == 0)
+    {
+        syncWorld();
+        checkpointer.begin(checkpoint_dir + "/autosave.ckpt", world);
+    }
+    world_version++;
+}
+
+//Quadro do estado atual no formato, do cache ou serializado agora (chamar com
+//world_mutex travado)
+frame_cache_t::frame_t currentFrame(frame_format_t format)
+{
+    return frames.get(world_version.load(), format * http_compression::ENCODINGS, [format] {
+        syncWorld();
+        return renderFormat(format, world);
+    });
+}
+
+//Quadro do estado atual na codificacao pedida (chamar com world_mutex travado)
+encoded_frame_t currentFrame(frame_format_t format, http_compression::encoding_t encoding)
+{
+    return encodeFrame(frames, world_version.load(), format, currentFrame(format), encoding);
+}
+
+//Quadro do ultimo tick, mas so trava o mundo se ele ainda nao esta no cache; a
+//compressao e feita fora da trava. A variante pedida passa a ser publicada a
+//cada tick
+encoded_frame_t latestFrame(frame_format_t format, http_compression::encoding_t encoding)
+{
+    wanted_variants |= 1u << (format * http_compression::ENCODINGS + encoding);
+    uint64_t version = world_version.load();
+    frame_cache_t::frame_t plain = frames.find(version, format * http_compression::ENCODINGS);
+    if (!plain)
+    {
+        std::lock_guard<std::mutex> lock(world_mutex);
+        version = world_version.load();
+        plain = currentFrame(format);
+    }
+    return encodeFrame(frames, version, format, plain, encoding);
+}
+
+//Publica o quadro do tick nas variantes pedidas desde o anterior (cells sempre):
+//os pedidos seguintes o encontram no cache. So a serializacao trava o mundo
+void publishFrames()
+{
+    uint32_t wanted = wanted_variants.exchange(0) | 1;
+    uint64_t version;
+    frame_cache_t::frame_t plain[3];
+    {
+        std::lock_guard<std::mutex> lock(world_mutex);
+        version = world_version.load();
+        for (uint32_t f = 0; f < 3; f++)
+        {
+            if (wanted >> (f * http_compression::ENCODINGS) & 7) plain[f] = currentFrame((frame_format_t)f);
+        }
+    }
+    for (uint32_t f = 0; f < 3; f++)
+    {
+        for (uint32_t e = 1; e < http_compression::ENCODINGS; e++)
+        {
+            if (wanted >> (f * http_compression::ENCODINGS + e) & 1) encodeFrame(frames, version, f, plain[f], (http_compression::encoding_t)e);
+        }
+    }
+}
+
+//Caminho do checkpoint `name` em checkpoint_dir; so aceita nomes simples
+std::string checkpointPath(const std::string &name)
+{
+    bool simple = !name.empty() && name[0] != '.' &&
+                  std::all_of(name.begin(), name.end(), [](char c) { return std::isalnum((unsigned char)c) || c == '.' || c == '_' || c == '-'; });
+    if (!simple) throw std::invalid_argument("bad checkpoint name: " + name);
+    return checkpoint_dir + "/" + name;
+}
+
+//Troca o mundo do servidor pelo checkpoint em path e recarrega os motores
+//(chamar com world_mutex travado). Com motor particionado ou arquivo mapeado,
+//as dimensoes e o layout precisam ser os do mundo atual.
+void restoreWorld(const std::string &path)
+{
+    world_file_header_t h = world_file::readHeader(path);
+    if ((engine || store) && (h.rows != world.rows || h.cols != world.cols || h.layout != world.layout))
+        throw std::invalid_argument("checkpoint is " + std::to_string(h.rows) + "x" + std::to_string(h.cols) + ", the running world is " +
+                                    std::to_string(world.rows) + "x" + std::to_string(world.cols));
+    checkpointer.settle();
+    world_file::load(path, world);
+    if (engine) engine->load(world);
+    world_stale = false;
+    if (tracker) tracker->attach(world);
+    if (active) active->attach(world);
+    if (store) store->sync(world, true);
+    if (!record_path.empty()) recorder.start(record_path, world, keyframe_every, record_packed);
+    world_version++;
+}
+
+//Le o valor de uma opcao "--nome valor" da linha de comando
+const char *option(int argc, char **argv, const char *name, const char *fallback = nullptr)
+{
+    for (int k = 1; k + 1 < argc; k++)
+    {
+        if (std::strcmp(argv[k], name) == 0) return argv[k + 1];
+    }
+    return fallback;
+}
+
+bool flag(int argc, char **argv, const char *name)
+{
+    for (int k = 1; k < argc; k++)
+    {
+        if (std::strcmp(argv[k], name) == 0) return true;
+    }
+    return false;
+}
+
+//Le "RxC" (ex.: 2x2) em numero de linhas e colunas de subdominios
+std::vector<rect_t> layoutOption(const world_t &w, const char *text)
+{
+    unsigned pr = 0, pc = 0;
+    if (std::sscanf(text, "%ux%u", &pr, &pc) != 2 || pr == 0 || pc == 0 || pr > w.rows || pc > w.cols)
+        throw std::invalid_argument(std::string("bad subdomain layout: ") + text);
+    return partitionGrid(w.rows, w.cols, pr, pc);
+}
+
+//Le "--grid-layout row-major|morton" (ordem das celulas na memoria)
+grid_layout_t gridLayoutOption(int argc, char **argv)
+{
+    std::string text = option(argc, argv, "--grid-layout", "row-major");
+    if (text == "row-major") return layout_row_major;
+    if (text == "morton") return layout_morton;
+    throw std::invalid_argument("bad grid layout: " + text);
+}
+
+//Le "--huge-pages off|thp|explicit" (paginas das grades grandes)
+grid_memory::huge_pages_t hugePagesOption(int argc, char **argv)
+{
+    std::string text = option(argc, argv, "--huge-pages", "off");
+    if (text == "off") return grid_memory::huge_off;
+    if (text == "thp") return grid_memory::huge_transparent;
+    if (text == "explicit") return grid_memory::huge_explicit;
+    throw std::invalid_argument("bad huge page mode: " + text);
+}
+
+//Os motores paralelo (--threads, --pin), esparso (--active-lists), em arquivo
+//(--world-file) e particionados e o rastreador (--track) rodam as regras de
+//intencoes; pedir um deles escolhe essas regras
+bool claimEngineOption(int argc, char **argv)
+{
+    return option(argc, argv, "--tiled") || option(argc, argv, "--distributed") || option(argc, argv, "--active-lists") ||
+           option(argc, argv, "--world-file") || option(argc, argv, "--threads") || flag(argc, argv, "--pin") || flag(argc, argv, "--track");
+}
+
+//Le "--rules original|claims" (regras do tick; ver nextIterationOriginal). Sem a
+//opcao, as regras originais, a menos que engines diga que um motor das regras
+//de intencoes foi pedido
+tick_rules_t rulesOption(int argc, char **argv, bool engines)
+{
+    const char *text = option(argc, argv, "--rules");
+    if (!text) return engines ? rules_claims : rules_original;
+    std::string name = text;
+    if (name == "claims") return rules_claims;
+    if (name != "original") throw std::invalid_argument("bad rules: " + name);
+    if (engines) throw std::invalid_argument("--rules original runs on the serial tick only (no --threads/--pin/--active-lists/--world-file/--track/--tiled/--distributed)");
+    return rules_original;
+}
+
+//Le "--compression-level N" (nivel do zlib nas respostas gzip/deflate, 0 desliga)
+int compressionLevelOption(int argc, char **argv)
+{
+    int level = std::stoi(option(argc, argv, "--compression-level", "6"));
+    if (level < 0 || level > 9) throw std::invalid_argument("bad compression level: " + std::to_string(level));
+    return level;
+}
+
+//Com "--world-file PATH" a grade de w passa a viver no arquivo: reabre o mundo
+//salvo nele (dimensoes, tick e populacao vem do arquivo) ou, se ele nao existe,
+//cria o arquivo a partir de w. "--resident-mb N" limita a memoria residente.
+std::unique_ptr<mapped_world_t> worldFileOption(int argc, char **argv, world_t &w)
+{
+    const char *path = option(argc, argv, "--world-file");
+    if (!path) return nullptr;
+    if (option(argc, argv, "--active-lists") || flag(argc, argv, "--track"))
+        throw std::invalid_argument("--world-file is not supported with --active-lists/--track");
+
+    std::unique_ptr<mapped_world_t> mapped(new mapped_world_t());
+    if (::access(path, F_OK) == 0)
+        mapped->open(path, w);
+    else
+        mapped->create(path, w);
+    mapped->setResidentBudget((size_t)std::stoull(option(argc, argv, "--resident-mb", "0")) << 20);
+    return mapped;
+}
+
+//Cria o motor particionado: processos (--distributed RxC) ou threads (--tiled RxC).
+//--halo-ticks k alarga o halo para k ticks entre trocas; --rebalance N refaz a
+//particao do motor com threads a cada N ticks se a carga estiver desigual.
+std::unique_ptr<partitioned_engine_t> startEngine(int argc, char **argv, const world_t &w)
+{
+    uint32_t exchangeTicks = std::stoul(option(argc, argv, "--halo-ticks", "1"));
+    if (exchangeTicks == 0) throw std::invalid_argument("--halo-ticks must be at least 1");
+
+    if (option(argc, argv, "--tiled"))
+    {
+        std::vector<rect_t> layout = layoutOption(w, option(argc, argv, "--tiled"));
+        unsigned threads = std::stoul(option(argc, argv, "--threads", std::to_string(layout.size()).c_str()));
+        tiled_engine_t *tiled = new tiled_engine_t(layout, exchangeTicks, threads, flag(argc, argv, "--pin"));
+        tiled->enableRebalance(std::stoul(option(argc, argv, "--rebalance", "0")),
+                               std::stod(option(argc, argv, "--rebalance-threshold", "1.2")));
+        return std::unique_ptr<partitioned_engine_t>(tiled);
+    }
+
+    if (option(argc, argv, "--rebalance")) throw std::invalid_argument("--rebalance requires --tiled");
+
+    std::string listen = option(argc, argv, "--listen", ("unix:/tmp/ecosim-" + std::to_string(::getpid()) + ".sock").c_str());
+    bool spawn = std::strcmp(option(argc, argv, "--spawn", "1"), "0") != 0;
+    return std::unique_ptr<partitioned_engine_t>(new cluster_t(listen, layoutOption(w, option(argc, argv, "--distributed")), spawn, exchangeTicks));
+}
+
+//Mundo inicial dos modos em lote: o checkpoint de --restore ou a semeadura aleatoria
+void batchWorld(int argc, char **argv, world_t &w)
+{
+    w.layout = gridLayoutOption(argc, argv);
+    if (option(argc, argv, "--restore"))
+    {
+        world_file::load(option(argc, argv, "--restore"), w);
+        return;
+    }
+    w.resize(std::stoul(option(argc, argv, "--rows", "64")), std::stoul(option(argc, argv, "--cols", option(argc, argv, "--rows", "64"))));
+    w.reset(std::stoull(option(argc, argv, "--seed", "1")));
+    startEcoSim(w, std::stoul(option(argc, argv, "--plants", "400")), std::stoul(option(argc, argv, "--herbivores", "100")),
+                std::stoul(option(argc, argv, "--carnivores", "20")));
+}
+
+//Saidas do lote: "--checkpoint PATH" grava o mundo ao fim dos ticks e, com
+//"--checkpoint-every N", tambem a cada N ticks, em segundo plano; "--record
+//PATH" grava a trajetoria de todos os ticks
+struct batch_outputs_t
+{
+    const char *path;
+    uint64_t every;
+    checkpoint_writer_t writer;
+    trajectory_recorder_t recorder;
+
+    batch_outputs_t(int argc, char **argv, const world_t &w)
+        : path(option(argc, argv, "--checkpoint")), every(std::stoull(option(argc, argv, "--checkpoint-every", "0")))
+    {
+        if (every && !path) throw std::invalid_argument("--checkpoint-every requires --checkpoint PATH");
+        if (option(argc, argv, "--record"))
+            recorder.start(option(argc, argv, "--record"), w, std::stoul(option(argc, argv, "--keyframe-every", "100")), flag(argc, argv, "--record-packed"));
+    }
+
+    void beforeTick(const world_t &w) { writer.beforeTick(w); }
+
+    void afterTick(const world_t &w)
+    {
+        recorder.push(w);
+        if (every && w.tick % every == 0) writer.begin(path, w);
+    }
+
+    void finish(const world_t &w)
+    {
+        if (recorder.recording())
+        {
+            recorder.finish();
+            trajectory_stats_t stats = recorder.stats();
+            std::printf("trajectory: %llu ticks, %llu keyframes, %.1f MB (%.0f bytes/tick), %llu stalls\n", (unsigned long long)stats.frames,
+                        (unsigned long long)stats.keyframes, stats.bytes / 1048576.0, (double)stats.bytes / std::max<uint64_t>(stats.frames, 1),
+                        (unsigned long long)stats.stalls);
+        }
+        writer.wait();
+        if (!path) return;
+        checkpoint_stats_t stats = writer.stats();
+        if (stats.written || stats.skipped || stats.failed)
+            std::printf("background checkpoints: %llu written, %llu skipped, %llu failed; last %.3f s, %.1f MB copied by the tick\n",
+                        (unsigned long long)stats.written, (unsigned long long)stats.skipped, (unsigned long long)stats.failed,
+                        stats.last_seconds, stats.last_copied_bytes / 1048576.0);
+        auto begin = std::chrono::steady_clock::now();
+        uint64_t bytes = world_file::save(path, w);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        std::printf("checkpoint %s: tick %llu, %.1f MB in %.3f s\n", path, (unsigned long long)w.tick, bytes / 1048576.0, seconds);
+    }
+};
+
+//Modo --distributed/--tiled com --ticks: roda em lote e, com --verify, compara
+//cada quadro montado com a simulacao em um unico processo
+int partitionedMain(int argc, char **argv)
+{
+    rulesOption(argc, argv, true);
+    world_t w;
+    batchWorld(argc, argv, w);
+    if (option(argc, argv, "--checkpoint-every") || option(argc, argv, "--record"))
+        throw std::invalid_argument("--checkpoint-every and --record are not supported with --tiled/--distributed --ticks");
+    batch_outputs_t outputs(argc, argv, w);
+    uint32_t ticks = std::stoul(option(argc, argv, "--ticks"));
+    bool verify = flag(argc, argv, "--verify");
+
+    world_t reference = w;
+    std::unique_ptr<partitioned_engine_t> workers = startEngine(argc, argv, w);
+    workers->load(w);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t t = 0; t < ticks; t += verify ? 1 : ticks)
+    {
+        workers->step(verify ? 1 : ticks);
+        if (!verify) continue;
+
+        workers->gather(w);
+        nextIteration(reference);
+        if (w.entity_grid.size() != reference.entity_grid.size() ||
+            std::memcmp(w.entity_grid.data(), reference.entity_grid.data(), w.entity_grid.size() * sizeof(cell_t)) != 0 ||
+            !(w.population == reference.population))
+        {
+            std::cerr << "MISMATCH at tick " << w.tick << std::endl;
+            return 1;
+        }
+    }
+    workers->gather(w);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    const population_t &pop = w.population;
+    std::printf("tick %llu hash %016llx plants %u herbivores %u carnivores %u (%.1f ticks/s, %llu halo exchanges)%s\n",
+                (unsigned long long)w.tick, (unsigned long long)gridHash(w), pop.plants, pop.herbivores, pop.carnivores,
+                ticks / seconds, (unsigned long long)workers->exchanges(), verify ? " verified" : "");
+
+    if (tiled_engine_t *tiled = dynamic_cast<tiled_engine_t *>(workers.get()))
+    {
+        const balance_stats_t &b = tiled->balanceStats();
+        if (b.checks)
+            std::printf("rebalance: %llu checks, %llu rebalances, %llu cells migrated in %.3f s, "
+                        "projected gain %.3f s (not measured), last imbalance %.2f\n",
+                        (unsigned long long)b.checks, (unsigned long long)b.rebalances, (unsigned long long)b.migrated_cells,
+                        b.migration_seconds, b.projected_seconds, b.last_imbalance);
+    }
+    outputs.finish(w);
+    return 0;
+}
+
+//Modo --ticks sem motor particionado: roda em lote com as regras originais ou,
+//nas regras de intencoes, escolhendo a cada tick entre o kernel sequencial e o
+//tick paralelo conforme a calibracao, ou com o tick esparso sobre listas de
+//seres vivos (--active-lists N)
+int adaptiveMain(int argc, char **argv)
+{
+    tick_rules_t rules = rulesOption(argc, argv, claimEngineOption(argc, argv));
+    world_t w;
+    batchWorld(argc, argv, w);
+    std::unique_ptr<mapped_world_t> mapped = worldFileOption(argc, argv, w);
+    batch_outputs_t outputs(argc, argv, w);
+    uint32_t ticks = std::stoul(option(argc, argv, "--ticks"));
+
+    if (mapped)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t t = 0; t < ticks; t++)
+        {
+            outputs.beforeTick(w);
+            nextIterationWavefront(w, mapped.get());
+            outputs.afterTick(w);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        mapped->sync(w, true);
+
+        const population_t &pop = w.population;
+        std::printf("tick %llu hash %016llx plants %u herbivores %u carnivores %u (%.1f ticks/s, %.1f MB world file%s)\n",
+                    (unsigned long long)w.tick, (unsigned long long)gridHash(w), pop.plants, pop.herbivores, pop.carnivores,
+                    ticks / seconds, mapped->size() / 1048576.0, mapped->evicting() ? ", evicting" : "");
+        outputs.finish(w);
+        return 0;
+    }
+
+    if (option(argc, argv, "--active-lists"))
+    {
+        active_ticker_t lists(std::stoul(option(argc, argv, "--active-lists")));
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t t = 0; t < ticks; t++)
+        {
+            outputs.beforeTick(w);
+            lists.step(w);
+            outputs.afterTick(w);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        const population_t &pop = w.population;
+        std::printf("tick %llu hash %016llx plants %u herbivores %u carnivores %u (%.1f ticks/s, active lists, %llu re-sorts)\n",
+                    (unsigned long long)w.tick, (unsigned long long)gridHash(w), pop.plants, pop.herbivores, pop.carnivores,
+                    ticks / seconds, (unsigned long long)lists.resorts());
+        outputs.finish(w);
+        return 0;
+    }
+
+    if (rules == rules_original)
+    {
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t t = 0; t < ticks; t++)
+        {
+            //O tick escreve na propria grade: os pedacos do checkpoint em
+            //andamento sao copiados quando a varredura chega neles
+            nextIterationOriginal(w, [&](uint32_t row) { outputs.writer.beforeRow(w, row); });
+            outputs.afterTick(w);
+        }
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        const population_t &pop = w.population;
+        std::printf("tick %llu hash %016llx plants %u herbivores %u carnivores %u (%.1f ticks/s, original rules)\n",
+                    (unsigned long long)w.tick, (unsigned long long)gridHash(w), pop.plants, pop.herbivores, pop.carnivores,
+                    ticks / seconds);
+        outputs.finish(w);
+        return 0;
+    }
+
+    adaptive_ticker_t adaptive(std::stoul(option(argc, argv, "--threads", std::to_string(std::thread::hardware_concurrency()).c_str())),
+                               flag(argc, argv, "--pin"));
+    adaptive.calibrate();
+    if (flag(argc, argv, "--pin")) adaptive.place(w);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t t = 0; t < ticks; t++)
+    {
+        outputs.beforeTick(w);
+        adaptive.step(w);
+        outputs.afterTick(w);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    const population_t &pop = w.population;
+    const tick_cost_t &c = adaptive.cost();
+    std::printf("tick %llu hash %016llx plants %u herbivores %u carnivores %u (%.1f ticks/s)\n", (unsigned long long)w.tick,
+                (unsigned long long)gridHash(w), pop.plants, pop.herbivores, pop.carnivores, ticks / seconds);
+    std::printf("%u threads: %.2f ns/cell, %.2f ns/entity, %.1f us/dispatch; %llu serial, %llu parallel ticks\n",
+                adaptive.threads(), c.cell_ns, c.entity_ns, c.dispatch_ns / 1000, (unsigned long long)adaptive.serialTicks(),
+                (unsigned long long)adaptive.parallelTicks());
+    outputs.finish(w);
+    return 0;
+}
+
+//Modo --check-allocations (so no ecosim_check): depois de aquecer, os ticks em
+//regime (regras originais; nas de intencoes, sequencial, paralelo, listas
+//ativas e motores particionados, incluindo a montagem do quadro) nao podem
+//alocar memoria no heap
+int allocationMain(int argc, char **argv)
+{
+    if (!alloc_counter::enabled()) throw std::invalid_argument("--check-allocations needs the ecosim_check program, which counts heap allocations");
+    const uint32_t warmup = 12, ticks = 60;
+    world_t initial(std::stoul(option(argc, argv, "--rows", "96")), std::stoul(option(argc, argv, "--cols", option(argc, argv, "--rows", "96"))));
+    initial.reset(std::stoull(option(argc, argv, "--seed", "1")));
+    startEcoSim(initial, initial.rows * initial.cols / 4, initial.rows * initial.cols / 20, initial.rows * initial.cols / 80);
+
+    bool ok = true;
+    auto measure = [&](const char *name, const std::function<void()> &tick) {
+        for (uint32_t t = 0; t < warmup; t++) tick();
+        uint64_t before = alloc_counter::allocations();
+        for (uint32_t t = 0; t < ticks; t++) tick();
+        uint64_t count = alloc_counter::allocations() - before;
+        std::printf("%s: %llu allocations in %u ticks%s\n", name, (unsigned long long)count, ticks, count ? " FAIL" : "");
+        ok &= count == 0;
+    };
+
+    //Regras originais (o tick padrao) e, daqui em diante, regras de intencoes
+    world_t w = initial;
+    measure("original", [&] { nextIterationOriginal(w); });
+
+    w = initial;
+    measure("claims serial", [&] { nextIteration(w); });
+
+    thread_pool_t pool(4);
+    w = initial;
+    measure("parallel x4", [&] { nextIterationParallel(w, pool); });
+
+    //A populacao ainda cresce nos primeiros ticks: as listas (e com elas a
+    //arena das reordenacoes) so param de crescer depois de um aquecimento maior
+    active_ticker_t lists;
+    w = initial;
+    for (uint32_t t = 0; t < 4 * warmup; t++) lists.step(w);
+    measure("active lists", [&] { lists.step(w); });
+
+    tiled_engine_t tiled(partitionGrid(initial.rows, initial.cols, 2, 2), 2, 4);
+    tiled.load(initial);
+    measure("tiled 2x2", [&] {
+        tiled.step(1);
+        tiled.gather(w);
+    });
+
+    cluster_t cluster("unix:/tmp/ecosim-alloc-" + std::to_string(::getpid()) + ".sock", partitionGrid(initial.rows, initial.cols, 2, 2), true, 2);
+    cluster.load(initial);
+    measure("distributed 2x2 (coordinator)", [&] {
+        cluster.step(1);
+        cluster.gather(w);
+    });
+    return ok ? 0 : 1;
+}
+
+//Modo --sweep: varredura de parametros sem servidor HTTP
+int sweepMain(int argc, char **argv)
+{
+    sweep_config_t config;
+    config.axes = sweep::parseAxes(option(argc, argv, "--sweep"));
+    config.rows = std::stoul(option(argc, argv, "--rows", std::to_string(config.rows).c_str()));
+    config.cols = std::stoul(option(argc, argv, "--cols", std::to_string(config.rows).c_str()));
+    config.plants = std::stoul(option(argc, argv, "--plants", std::to_string(config.plants).c_str()));
+    config.herbivores = std::stoul(option(argc, argv, "--herbivores", std::to_string(config.herbivores).c_str()));
+    config.carnivores = std::stoul(option(argc, argv, "--carnivores", std::to_string(config.carnivores).c_str()));
+    config.ticks = std::stoul(option(argc, argv, "--ticks", std::to_string(config.ticks).c_str()));
+    config.replicates = std::stoul(option(argc, argv, "--replicates", std::to_string(config.replicates).c_str()));
+    config.threads = std::stoul(option(argc, argv, "--threads", std::to_string(config.threads).c_str()));
+    config.seed = std::stoull(option(argc, argv, "--seed", std::to_string(config.seed).c_str()));
+    config.rules = rulesOption(argc, argv, false);
+
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<sweep_result_t> results = runSweep(config);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    const char *out = option(argc, argv, "--out");
+    if (out)
+    {
+        std::ofstream file(out);
+        writeSweepTable(file, config, results);
+    }
+    else
+    {
+        writeSweepTable(std::cout, config, results);
+    }
+    std::cerr << results.size() << " jobs in " << seconds << " s" << std::endl;
+    return 0;
+}
+
+//Servidor sem simulacao que serve os quadros de uma trajetoria gravada com
+//--record: a pagina toca, pausa e pula para qualquer tick
+int replayMain(int argc, char **argv)
+{
+    static replay_pool_t replay(option(argc, argv, "--replay"),
+                                std::stoul(option(argc, argv, "--replay-cursors", std::to_string(std::max(std::thread::hardware_concurrency(), 2u)).c_str())));
+    //Quadros recentes, compartilhados por quem olha o mesmo tick
+    static frame_cache_t cache(std::stoul(option(argc, argv, "--replay-cache", "64")));
+    compression_level = compressionLevelOption(argc, argv);
+    const trajectory_reader_t &info = replay.info();
+    std::cerr << "replaying " << option(argc, argv, "--replay") << ": " << info.rows() << "x" << info.cols() << ", ticks " << info.firstTick()
+              << ".." << info.lastTick() << ", " << info.keyframes().size() << " keyframes, " << replay.cursors() << " cursors" << std::endl;
+
+    crow::SimpleApp app;
+
+    // Endpoint to serve the HTML page
+    CROW_ROUTE(app, "/")
+    ([](const crow::request &req, crow::response &res)
+     { pageResponse(req, res); });
+
+    // Endpoint to describe the recording being replayed
+    CROW_ROUTE(app, "/replay")
+        .methods("GET"_method)([]()
+                               {
+        const trajectory_reader_t &info = replay.info();
+        frame_cache_stats_t stats = cache.stats();
+        nlohmann::json json = {{"rows", info.rows()}, {"cols", info.cols()}, {"first", info.firstTick()}, {"last", info.lastTick()},
+                               {"keyframes", info.keyframes().size()}, {"keyframe_every", info.keyframeEvery()},
+                               {"frame_hits", stats.hits}, {"frame_renders", stats.renders}};
+        return json.dump(); });
+
+    // Endpoint to return the entity grid at a recorded tick (?tick=T, &format= as in /next-iteration)
+    CROW_ROUTE(app, "/replay/frame")
+        .methods("GET"_method)([](const crow::request &req)
+                               {
+        crow::response res;
+        try
+        {
+            const char *text = req.url_params.get("tick");
+            if (!text) throw std::invalid_argument("missing tick");
+            uint64_t tick = std::stoull(text);
+            frame_format_t format = frameFormat(req);
+            frame_cache_t::frame_t plain = cache.get(tick, format * http_compression::ENCODINGS, [&] {
+                std::string frame;
+                replay.frame(tick, [&](const world_t &w) { frame = renderFormat(format, w); });
+                return frame;
+            });
+            res = frameResponse(format, encodeFrame(cache, tick, format, plain, frameEncoding(req, format)));
+        }
+        catch (const std::exception &e)
+        {
+            res = crow::response(400, e.what());
+        }
+        return res; });
+
+    app.port(8080).run();
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    grid_memory::policy() = hugePagesOption(argc, argv);
+    if (flag(argc, argv, "--check-determinism")) return checkDeterminism(std::cout) & checkFrameJson(std::cout) ? 0 : 1;
+    if (flag(argc, argv, "--check-allocations")) return allocationMain(argc, argv);
+    if (option(argc, argv, "--sweep")) return sweepMain(argc, argv);
+    if (option(argc, argv, "--worker")) return distributed::workerMain(option(argc, argv, "--worker"));
+    if (option(argc, argv, "--replay")) return replayMain(argc, argv);
+    bool partitioned = option(argc, argv, "--distributed") || option(argc, argv, "--tiled");
+    if (partitioned && option(argc, argv, "--world-file")) throw std::invalid_argument("--world-file is not supported with --tiled/--distributed");
+    if (option(argc, argv, "--ticks")) return partitioned ? partitionedMain(argc, argv) : adaptiveMain(argc, argv);
+
+    tick_rules_t rules = rulesOption(argc, argv, claimEngineOption(argc, argv));
+    world.layout = gridLayoutOption(argc, argv);
+    world.resize(std::stoul(option(argc, argv, "--rows", std::to_string(NUM_ROWS).c_str())),
+                 std::stoul(option(argc, argv, "--cols", option(argc, argv, "--rows", std::to_string(NUM_ROWS).c_str()))));
+    if (partitioned) engine = startEngine(argc, argv, world);
+    else if (option(argc, argv, "--world-file")) store = worldFileOption(argc, argv, world);
+    else if (option(argc, argv, "--active-lists")) active.reset(new active_ticker_t(std::stoul(option(argc, argv, "--active-lists"))));
+    else if (rules == rules_claims)
+    {
+        ticker.reset(new adaptive_ticker_t(std::stoul(option(argc, argv, "--threads", std::to_string(std::thread::hardware_concurrency()).c_str())),
+                                           flag(argc, argv, "--pin")));
+        ticker->calibrate();
+        if (flag(argc, argv, "--pin")) ticker->place(world);
+        const tick_cost_t &c = ticker->cost();
+        std::cerr << "tick cost: " << c.cell_ns << " ns/cell, " << c.entity_ns << " ns/entity, " << c.dispatch_ns / 1000
+                  << " us/dispatch on " << ticker->threads() << " threads" << std::endl;
+    }
+    else
+        std::cerr << "original rules: serial tick, no serial/parallel selection (use --rules claims for it)" << std::endl;
+    if (flag(argc, argv, "--track"))
+    {
+        if (engine) throw std::invalid_argument("--track is not supported with --tiled/--distributed");
+        tracker.reset(new entity_tracker_t());
+    }
+    if (option(argc, argv, "--seed")) fixed_seed.reset(new uint64_t(std::stoull(option(argc, argv, "--seed"))));
+    checkpoint_dir = option(argc, argv, "--checkpoint-dir", ".");
+    checkpoint_every = std::stoull(option(argc, argv, "--checkpoint-every", "0"));
+    record_path = option(argc, argv, "--record", "");
+    keyframe_every = std::stoul(option(argc, argv, "--keyframe-every", "100"));
+    record_packed = flag(argc, argv, "--record-packed");
+    compression_level = compressionLevelOption(argc, argv);
+    if (option(argc, argv, "--restore")) restoreWorld(option(argc, argv, "--restore"));
+
+    pacer.reset(new pacer_t(
+        [] {
+            std::lock_guard<std::mutex> lock(world_mutex);
+            advance();
+        },
+        publishFrames));
+    if (option(argc, argv, "--tick-rate")) pacer->setRate(std::stod(option(argc, argv, "--tick-rate")));
+
+    crow::SimpleApp app;
+
+    // Endpoint to serve the HTML page
+    CROW_ROUTE(app, "/")
+    ([](const crow::request &req, crow::response &res)
+     {
+        // Return the HTML content here (compressed when the browser accepts it)
+        pageResponse(req, res); });
+
+    CROW_ROUTE(app, "/start-simulation")
+        .methods("POST"_method)([](crow::request &req, crow::response &res)
+                                {
+        // Parse the JSON request body
+        nlohmann::json request_body = nlohmann::json::parse(req.body);
+
+       // Validate the request body
+        uint32_t total_entinties = (uint32_t)request_body["plants"] + (uint32_t)request_body["herbivores"] + (uint32_t)request_body["carnivores"];
+        if (total_entinties > world.rows * world.cols) {
+            res.code = 400;
+            res.body = "Too many entities";
+            res.end();
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(world_mutex);
+
+        // Clear the entity grid (the same seed always gives the same simulation)
+        uint64_t seed = fixed_seed ? *fixed_seed : std::random_device{}();
+        if (request_body.contains("seed")) seed = request_body["seed"].get<uint64_t>();
+        checkpointer.settle();
+        world.reset(seed);
+
+        // Create the entities
+        startEcoSim(world, (uint32_t)request_body["plants"], (uint32_t)request_body["herbivores"], (uint32_t)request_body["carnivores"]);
+        if (engine) engine->load(world);
+        world_stale = false;
+        if (tracker) tracker->attach(world);
+        if (active) active->attach(world);
+        if (!record_path.empty()) recorder.start(record_path, world, keyframe_every, record_packed);
+        world_version++;
+
+        // Return the JSON representation of the entity grid
+        res = frameResponse(format_cells, currentFrame(format_cells, responseEncoding(req)));
+        res.end(); });
+
+    // Endpoint to process HTTP GET requests for the next simulation iteration
+    // (?format=cells, the default, rows or packed; see frameFormat)
+    CROW_ROUTE(app, "/next-iteration")
+        .methods("GET"_method)([](const crow::request &req)
+                               {
+        frame_format_t format;
+        http_compression::encoding_t encoding;
+        try
+        {
+            format = frameFormat(req);
+            encoding = frameEncoding(req, format);
+        }
+        catch (const std::exception &e)
+        {
+            return crow::response(400, e.what());
+        }
+
+        // When the server paces the simulation, return the frame of the latest tick (shared by all viewers)
+        if (pacer->stats().target_rate > 0) return frameResponse(format, latestFrame(format, encoding));
+
+        // Simulate the next iteration and return the entity grid (compressed after releasing the world)
+        frame_cache_t::frame_t frame;
+        uint64_t version;
+        {
+            std::lock_guard<std::mutex> lock(world_mutex);
+            advance();
+            version = world_version.load();
+            frame = currentFrame(format);
+        }
+        return frameResponse(format, encodeFrame(frames, version, format, frame, encoding)); });
+
+    // Endpoint to save the world as a binary checkpoint in the background ({"name": file in --checkpoint-dir})
+    // or to read (GET) the state of the background writer
+    CROW_ROUTE(app, "/checkpoint")
+        .methods("GET"_method, "POST"_method)([](const crow::request &req, crow::response &res)
+                                              {
+        if (req.method == "POST"_method)
+        {
+            try
+            {
+                std::string path = checkpointPath(nlohmann::json::parse(req.body)["name"].get<std::string>());
+                std::lock_guard<std::mutex> lock(world_mutex);
+                syncWorld();
+                if (!checkpointer.begin(path, world))
+                {
+                    res.code = 409;
+                    res.body = "a checkpoint is still being written";
+                    res.end();
+                    return;
+                }
+                res.code = 202;
+            }
+            catch (const std::exception &e)
+            {
+                res.code = 400;
+                res.body = e.what();
+                res.end();
+                return;
+            }
+        }
+
+        checkpoint_stats_t stats = checkpointer.stats();
+        res.body = nlohmann::json{{"busy", stats.busy}, {"written", stats.written}, {"skipped", stats.skipped},
+                                  {"failed", stats.failed}, {"last_error", stats.last_error}, {"path", stats.last_path},
+                                  {"tick", stats.last_tick}, {"bytes", stats.last_bytes}, {"ms", stats.last_seconds * 1000},
+                                  {"copied_bytes", stats.last_copied_bytes}}.dump();
+        res.end(); });
+
+    // Endpoint to replace the world with a checkpoint ({"name": file in --checkpoint-dir}) and return its frame
+    CROW_ROUTE(app, "/restore")
+        .methods("POST"_method)([](const crow::request &req, crow::response &res)
+                                {
+        try
+        {
+            std::string path = checkpointPath(nlohmann::json::parse(req.body)["name"].get<std::string>());
+            std::lock_guard<std::mutex> lock(world_mutex);
+            restoreWorld(path);
+            res = frameResponse(format_cells, currentFrame(format_cells, responseEncoding(req)));
+        }
+        catch (const std::exception &e)
+        {
+            res.code = 400;
+            res.body = e.what();
+        }
+        res.end(); });
+
+    // Endpoint to look up the entity at a cell (requires --track): stable id, birth tick, parent and moves
+    CROW_ROUTE(app, "/entity")
+        .methods("GET"_method)([](const crow::request &req, crow::response &res)
+                               {
+        uint32_t i, j;
+        try
+        {
+            i = uintParam(req, "i", UINT32_MAX);
+            j = uintParam(req, "j", UINT32_MAX);
+        }
+        catch (const std::exception &e)
+        {
+            res.code = 400;
+            res.body = e.what();
+            res.end();
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(world_mutex);
+        if (!tracker || !tracker->attached(world) || i >= world.rows || j >= world.cols)
+        {
+            res.code = 400;
+            res.end();
+            return;
+        }
+
+        handle_t h = tracker->handleAt(world, i, j);
+        const entity_record_t *r = tracker->record(h);
+        if (!r)
+        {
+            res.code = 404;
+            res.end();
+            return;
+        }
+        nlohmann::json json = {{"id", h.bits}, {"slot", h.index()}, {"generation", h.generation()},
+                               {"born_tick", r->born_tick}, {"parent", r->parent.bits}, {"moves", r->moves},
+                               {"entity", unpackCell(world.at(i, j))}};
+        res.body = json.dump();
+        res.end(); });
+
+    // Endpoint to read the live population and the births, deaths and meals of the last tick, per species
+    CROW_ROUTE(app, "/stats")
+        .methods("GET"_method)([]()
+                               {
+        std::lock_guard<std::mutex> lock(world_mutex);
+        population_t pop = engine ? engine->population() : world.population;
+        tick_counts_t counts = engine ? engine->lastCounts() : world.last_counts;
+
+        nlohmann::json json = {{"tick", world.tick},
+                               {"population", {{"plants", pop.plants}, {"herbivores", pop.herbivores}, {"carnivores", pop.carnivores}}}};
+        const char *names[4] = {nullptr, "plants", "herbivores", "carnivores"};
+        for (int t = plant; t <= carnivore; t++)
+        {
+            json["births"][names[t]] = counts.births[t];
+            json["deaths"][names[t]] = counts.deaths[t];
+            json["eats"][names[t]] = counts.eats[t];
+        }
+        return json.dump(); });
+
+    // Endpoint to read per-species counts over blocks of 2^level x 2^level cells, in the block window
+    // [y0, y0 + h) x [x0, x0 + w) of that level (rows and columns of blocks; defaults to the whole level)
+    CROW_ROUTE(app, "/density")
+        .methods("GET"_method)([](const crow::request &req, crow::response &res)
+                               {
+        auto param = [&](const char *name, uint32_t fallback) { return uintParam(req, name, fallback); };
+
+        std::lock_guard<std::mutex> lock(world_mutex);
+        syncSpecies();
+        density.update(world);
+
+        uint32_t k;
+        try
+        {
+            k = param("level", 0);
+            if (k >= density.levels()) throw std::invalid_argument("level must be below " + std::to_string(density.levels()));
+            for (const char *name : {"x0", "y0", "w", "h"}) param(name, 0);
+        }
+        catch (const std::exception &e)
+        {
+            res.code = 400;
+            res.body = e.what();
+            res.end();
+            return;
+        }
+        uint32_t y0 = std::min(param("y0", 0), density.rows(k)), x0 = std::min(param("x0", 0), density.cols(k));
+        uint32_t h = std::min(param("h", density.rows(k)), density.rows(k) - y0), w = std::min(param("w", density.cols(k)), density.cols(k) - x0);
+
+        std::vector<uint32_t> plants, herbivores, carnivores;
+        plants.reserve((size_t)w * h);
+        herbivores.reserve((size_t)w * h);
+        carnivores.reserve((size_t)w * h);
+        for (uint32_t i = y0; i < y0 + h; i++)
+        {
+            for (uint32_t j = x0; j < x0 + w; j++)
+            {
+                population_t c = density.count(world, k, i, j);
+                plants.push_back(c.plants);
+                herbivores.push_back(c.herbivores);
+                carnivores.push_back(c.carnivores);
+            }
+        }
+        nlohmann::json json = {{"tick", world.tick}, {"level", k}, {"levels", density.levels()}, {"scale", 1u << k},
+                               {"rows", density.rows(k)}, {"cols", density.cols(k)},
+                               {"x0", x0}, {"y0", y0}, {"w", w}, {"h", h},
+                               {"plants", plants}, {"herbivores", herbivores}, {"carnivores", carnivores}};
+        res.body = json.dump();
+        res.end(); });
+
+    // Endpoint to read (GET) or change (POST {"rate": ticks per second, 0 = off}) the server-side pacing
+    CROW_ROUTE(app, "/pace")
+        .methods("GET"_method, "POST"_method)([](const crow::request &req)
+                                              {
+        if (req.method == "POST"_method)
+        {
+            try
+            {
+                double rate = nlohmann::json::parse(req.body).at("rate").get<double>();
+                if (!std::isfinite(rate) || rate < 0) throw std::invalid_argument("rate must be a finite number >= 0");
+                pacer->setRate(rate);
+            }
+            catch (const std::exception &e)
+            {
+                return crow::response(400, e.what());
+            }
+        }
+
+        pace_stats_t stats = pacer->stats();
+        frame_cache_stats_t cached = frames.stats();
+        nlohmann::json json = {{"target_rate", stats.target_rate}, {"tick_rate", stats.tick_rate},
+                               {"lag_ms", stats.lag_seconds * 1000}, {"ticks", stats.ticks},
+                               {"frames", stats.frames}, {"skipped_frames", stats.skipped_frames},
+                               {"dropped_ticks", stats.dropped_ticks},
+                               {"frame_hits", cached.hits}, {"frame_renders", cached.renders}};
+        return crow::response(json.dump()); });
+    app.port(8080).run();
+    pacer->stop();
+    if (store) store->sync(world, true);
+
+    return 0;
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "ecosim.hpp"
+#include "world_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+//Linhas de cada faixa do tick em frente de onda
+const uint32_t WAVE_ROWS = 16;
+static_assert(WAVE_ROWS % (1u << MORTON_TILE_BITS) == 0, "wave bands must hold whole Morton tiles");
+
+//Grade do mundo guardada em um arquivo mapeado (MAP_SHARED, formato de
+//world_file.hpp com os quatro planos): os buffers de
+//world_t passam a apontar para o arquivo, entao o mundo pode ser maior que a
+//memoria e reabrir um mundo pausado e so um mmap. Com um orcamento de memoria
+//residente, o tick em frente de onda pede as faixas seguintes com
+//MADV_WILLNEED e devolve ao kernel as que ja passaram (MADV_PAGEOUT).
+class mapped_world_t
+{
+public:
+    mapped_world_t() = default;
+    ~mapped_world_t() { close(); }
+
+    mapped_world_t(const mapped_world_t &) = delete;
+    mapped_world_t &operator=(const mapped_world_t &) = delete;
+
+    //Cria o arquivo com o estado de w e passa a grade de w para ele
+    void create(const std::string &path, world_t &w)
+    {
+        close();
+        world_file_header_t h = world_file::describe(w, 4);
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || ::ftruncate(fd, (off_t)h.file_bytes) != 0) throw world_file::error("create " + path);
+        mapFile(path, h.file_bytes);
+        header() = h;
+
+        std::copy(w.entity_grid.begin(), w.entity_grid.end(), plane<cell_t>(0));
+        std::copy(w.next_grid.begin(), w.next_grid.end(), plane<cell_t>(1));
+        std::copy(w.claims.begin(), w.claims.end(), plane<uint8_t>(2));
+        std::copy(w.winners.begin(), w.winners.end(), plane<uint8_t>(3));
+        bind(w);
+        sync(w, true);
+    }
+
+    //Abre um arquivo criado por create e monta w sobre ele, sem copiar a grade
+    void open(const std::string &path, world_t &w)
+    {
+        close();
+        fd = ::open(path.c_str(), O_RDWR);
+        struct stat st;
+        if (fd < 0 || ::fstat(fd, &st) != 0) throw world_file::error("open " + path);
+        if ((size_t)st.st_size < sizeof(world_file_header_t)) throw std::runtime_error(path + ": not a world file");
+        mapFile(path, (size_t)st.st_size);
+
+        const world_file_header_t &h = header();
+        world_file::check(h, bytes, path);
+        if (h.planes != 4) throw std::runtime_error(path + ": checkpoint files hold only the grid; load them with --restore");
+        world_file::adopt(h, map + h.rng_offset, w, false);
+        bind(w);
+    }
+
+    //Grava no cabecalho o que muda a cada tick (e so memoria do mapeamento);
+    //com flush, grava tambem o gerador e agenda a escrita das paginas sujas
+    void sync(const world_t &w, bool flush = false)
+    {
+        world_file_header_t &h = header();
+        h.tick = w.tick;
+        h.seed = w.seed;
+        h.params = w.params;
+        h.population = w.population;
+        h.current = w.entity_grid.data() == plane<cell_t>(0) ? 0 : 1;
+        if (!flush) return;
+        std::string rng = world_file::rngState(w);
+        std::copy(rng.begin(), rng.end(), map + h.rng_offset);
+        h.rng_bytes = rng.size();
+        ::msync(map, bytes, MS_ASYNC);
+    }
+
+    bool attached(const world_t &w) const
+    {
+        return map && (w.entity_grid.data() == plane<cell_t>(0) || w.entity_grid.data() == plane<cell_t>(1));
+    }
+
+    size_t size() const { return bytes; }
+
+    //Memoria residente que o tick pode usar; 0 = sem limite (nenhum aviso)
+    void setResidentBudget(size_t budget) { resident_budget = budget; }
+    bool evicting() const { return map && resident_budget && bytes > resident_budget; }
+
+    //Pede ao kernel as linhas [r0, r1) de todos os planos
+    void prefetch(const world_t &w, uint32_t r0, uint32_t r1) { advise(w, r0, r1, MADV_WILLNEED); }
+
+    //Devolve ao kernel as linhas [r0, r1): paginas sujas sao escritas no arquivo
+    void release(const world_t &w, uint32_t r0, uint32_t r1) { advise(w, r0, r1, MADV_PAGEOUT); }
+
+    void close()
+    {
+        if (map) ::munmap(map, bytes);
+        if (fd >= 0) ::close(fd);
+        map = nullptr;
+        fd = -1;
+        bytes = 0;
+    }
+
+private:
+    void mapFile(const std::string &path, size_t size)
+    {
+        void *p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) throw world_file::error("mmap " + path);
+        map = static_cast<char *>(p);
+        bytes = size;
+    }
+
+    world_file_header_t &header() const { return *reinterpret_cast<world_file_header_t *>(map); }
+
+    template <class T>
+    T *plane(int p) const { return reinterpret_cast<T *>(map + header().offsets[p]); }
+
+    //Troca os buffers de w pelos planos do arquivo (o alocador apenas adota a regiao)
+    void bind(world_t &w)
+    {
+        const world_file_header_t &h = header();
+        size_t cells = h.cells;
+        cell_t *current = plane<cell_t>(h.current), *next = plane<cell_t>(1 - h.current);
+        w.entity_grid = grid_vector_t<cell_t>(cells, grid_allocator_t<cell_t>(current, cells * sizeof(cell_t)));
+        w.next_grid = grid_vector_t<cell_t>(cells, grid_allocator_t<cell_t>(next, cells * sizeof(cell_t)));
+        w.claims = grid_vector_t<uint8_t>(cells, grid_allocator_t<uint8_t>(plane<uint8_t>(2), cells));
+        w.winners = grid_vector_t<uint8_t>(cells, grid_allocator_t<uint8_t>(plane<uint8_t>(3), cells));
+        w.touchAll();
+    }
+
+    void advise(const world_t &w, uint32_t r0, uint32_t r1, int advice)
+    {
+        if (!evicting() || r0 >= r1) return;
+        uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+        size_t begin = w.rowStart(r0), end = w.rowStart(r1);
+        for (int p = 0; p < 4; p++)
+        {
+            size_t unit = p < 2 ? sizeof(cell_t) : sizeof(uint8_t);
+            uintptr_t lo = (uintptr_t)(map + header().offsets[p] + begin * unit), hi = (uintptr_t)(map + header().offsets[p] + end * unit);
+            //WILLNEED cobre as paginas tocadas; PAGEOUT so as inteiras, para nao
+            //despejar a borda das faixas vizinhas
+            lo = advice == MADV_WILLNEED ? lo & ~(page - 1) : (lo + page - 1) & ~(page - 1);
+            hi = advice == MADV_WILLNEED ? (hi + page - 1) & ~(page - 1) : hi & ~(page - 1);
+            if (lo < hi) ::madvise((void *)lo, hi - lo, advice);
+        }
+    }
+
+    int fd = -1;
+    char *map = nullptr;
+    size_t bytes = 0;
+    size_t resident_budget = 0;
+};
+
+//Tick em uma unica passada sobre faixas de WAVE_ROWS linhas: a faixa b decide
+//enquanto a b - 1 resolve e a b - 2 aplica. Cada fase so le as linhas vizinhas
+//ja processadas pela fase anterior, entao o resultado e identico ao de
+//nextIteration, mas so cerca de quatro faixas de cada plano precisam estar na
+//memoria ao mesmo tempo. Com um mundo mapeado acima do orcamento, a faixa
+//seguinte e pedida antes de decidir e as ja aplicadas sao devolvidas.
+inline void nextIterationWavefront(world_t &w, mapped_world_t *store = nullptr)
+{
+    tick_counts_t counts;
+    uint32_t bands = (w.rows + WAVE_ROWS - 1) / WAVE_ROWS;
+    auto first = [&](uint32_t b) { return std::min(b * WAVE_ROWS, w.rows); };
+    for (uint32_t s = 0; s < bands + 2; s++)
+    {
+        if (s < bands)
+        {
+            if (store) store->prefetch(w, first(s + 1), first(s + 2));
+            ecosim::decideRows(w, first(s), first(s + 1));
+        }
+        if (s >= 1 && s <= bands) ecosim::resolveRows(w, first(s - 1), first(s));
+        if (s >= 2)
+        {
+            ecosim::applyRows(w, counts, first(s - 2), first(s - 1));
+            if (store && s >= 4) store->release(w, first(s - 4), first(s - 3));
+        }
+    }
+    ecosim::finishTick(w, counts);
+    if (store) store->sync(w);
+}
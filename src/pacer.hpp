@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+//Numeros do laco em tempo real, para relatorio
+struct pace_stats_t
+{
+    double target_rate = 0;
+    double tick_rate = 0;
+    double lag_seconds = 0;
+    uint64_t ticks = 0;
+    uint64_t frames = 0;
+    uint64_t skipped_frames = 0;
+    uint64_t dropped_ticks = 0;
+};
+
+//Laco de passo fixo em uma thread propria: avanca a simulacao no ritmo pedido
+//e publica um quadro por volta do laco. Se um tick estoura o prazo, os ticks
+//atrasados rodam em seguida sem gerar quadros intermediarios; se o atraso
+//passa de MAX_CATCHUP_TICKS, o restante e descartado para nao acumular.
+class pacer_t
+{
+public:
+    static const uint32_t MAX_CATCHUP_TICKS = 8;
+
+    pacer_t(std::function<void()> tickFn, std::function<void()> publishFn)
+        : tick(std::move(tickFn)), publish(std::move(publishFn))
+    {
+    }
+
+    ~pacer_t() { stop(); }
+
+    pacer_t(const pacer_t &) = delete;
+    pacer_t &operator=(const pacer_t &) = delete;
+
+    //Ajusta o ritmo (ticks por segundo); 0 pausa o laco. Pode ser chamado de
+    //varias threads: a thread do laco e criada uma unica vez, sob a trava
+    void setRate(double rate)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            current.target_rate = std::max(rate, 0.0);
+            changed = true;
+            if (!worker.joinable() && !stopping) worker = std::thread([this] { loop(); });
+        }
+        wake.notify_all();
+    }
+
+    void stop()
+    {
+        std::thread finished;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+            finished = std::move(worker);
+        }
+        wake.notify_all();
+        if (finished.joinable()) finished.join();
+    }
+
+    pace_stats_t stats() const
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return current;
+    }
+
+private:
+    using steady = std::chrono::steady_clock;
+
+    void loop()
+    {
+        steady::time_point next = steady::now(), window = next;
+        uint64_t windowTicks = 0;
+        std::unique_lock<std::mutex> lock(mtx);
+        while (!stopping)
+        {
+            if (changed)
+            {
+                changed = false;
+                next = steady::now();
+            }
+            if (current.target_rate <= 0)
+            {
+                current.tick_rate = 0;
+                current.lag_seconds = 0;
+                wake.wait(lock, [this] { return stopping || changed; });
+                continue;
+            }
+            if (wake.wait_until(lock, next, [this] { return stopping || changed; })) continue;
+
+            auto period = std::chrono::duration_cast<steady::duration>(std::chrono::duration<double>(1.0 / current.target_rate));
+            lock.unlock();
+            uint32_t ran = 0;
+            steady::time_point now = steady::now();
+            while (now >= next && ran < MAX_CATCHUP_TICKS)
+            {
+                tick();
+                next += period;
+                ran++;
+                now = steady::now();
+            }
+            if (ran == 0)
+            {
+                lock.lock();
+                continue;
+            }
+            uint64_t dropped = 0;
+            if (now >= next)
+            {
+                dropped = (uint64_t)((now - next) / period) + 1;
+                next = now + period;
+            }
+            publish();
+            lock.lock();
+
+            current.ticks += ran;
+            current.frames++;
+            current.skipped_frames += ran - 1;
+            current.dropped_ticks += dropped;
+            //Atraso em relacao ao prazo do proximo tick (0 quando o ritmo esta em dia)
+            current.lag_seconds = std::max(0.0, std::chrono::duration<double>(steady::now() - next).count());
+
+            //Ritmo real medido em janelas de um segundo
+            windowTicks += ran;
+            double elapsed = std::chrono::duration<double>(now - window).count();
+            if (elapsed >= 1.0)
+            {
+                current.tick_rate = windowTicks / elapsed;
+                windowTicks = 0;
+                window = now;
+            }
+        }
+    }
+
+    std::function<void()> tick;
+    std::function<void()> publish;
+    mutable std::mutex mtx;
+    std::condition_variable wake;
+    std::thread worker;
+    pace_stats_t current;
+    bool changed = false;
+    bool stopping = false;
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include "arena.hpp"
+#include "ecosim.hpp"
+#include "thread_pool.hpp"
+#include "tracking.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+//Linhas de cada tarefa do tick paralelo
+const uint32_t BAND_ROWS = 16;
+
+//Cada linha de ladrilhos sujos fica inteira em uma faixa: as threads nunca
+//marcam o mesmo byte
+static_assert(BAND_ROWS % (1u << DIRTY_TILE_BITS) == 0, "bands must cover whole dirty-tile rows");
+
+//Um tick com as tres fases divididas em faixas de linhas entre as threads do
+//pool, com uma barreira entre fases. Cada celula so le o estado da fase
+//anterior e so escreve na propria posicao, entao o resultado e identico bit a
+//bit ao de nextIteration para qualquer numero de threads. Com um rastreador, o
+//plano de handles e refeito (em sequencia) antes da troca de grades.
+//Os eventos da fase 3 sao somados por thread, cada uma na sua linha de cache,
+//e juntados depois da barreira.
+inline void nextIterationParallel(world_t &w, thread_pool_t &pool, entity_tracker_t *tracker = nullptr)
+{
+    struct alignas(64) thread_counts_t
+    {
+        tick_counts_t counts;
+    };
+    //As somas vem da arena da thread chamadora (as tarefas recebem o ponteiro)
+    arena_t &arena = tickArena();
+    thread_counts_t *partial = arena.make<thread_counts_t>(pool.size());
+    for (unsigned t = 0; t < pool.size(); t++) new (&partial[t]) thread_counts_t();
+
+    size_t bands = (w.rows + BAND_ROWS - 1) / BAND_ROWS;
+    auto phase = [&](void (*rows)(world_t &, uint32_t, uint32_t, uint32_t, uint32_t)) {
+        pool.run(bands, [&](size_t b, unsigned) {
+            uint32_t r0 = (uint32_t)b * BAND_ROWS;
+            rows(w, r0, std::min(r0 + BAND_ROWS, w.rows), 0, UINT32_MAX);
+        });
+    };
+    phase(ecosim::decideRows);
+    phase(ecosim::resolveRows);
+    pool.run(bands, [&](size_t b, unsigned t) {
+        uint32_t r0 = (uint32_t)b * BAND_ROWS;
+        ecosim::applyRows(w, partial[t].counts, r0, std::min(r0 + BAND_ROWS, w.rows));
+    });
+    if (tracker) tracker->update(w);
+
+    tick_counts_t counts;
+    for (unsigned t = 0; t < pool.size(); t++) counts += partial[t].counts;
+    arena.reset();
+    ecosim::finishTick(w, counts);
+}
+
+//Realoca os buffers de w e copia a grade, inicializando cada faixa de linhas
+//na thread do pool que vai processa-la no tick paralelo. Com um pool pinned,
+//as paginas de cada faixa ficam no no NUMA da thread dona (primeiro toque).
+inline void placeWorld(world_t &w, thread_pool_t &pool)
+{
+    grid_vector_t<cell_t> cells = std::move(w.entity_grid);
+    w.resizeWindow(w.rows, w.cols, w.row0, w.col0, w.world_rows, w.world_cols, false);
+    size_t bands = (w.rows + BAND_ROWS - 1) / BAND_ROWS;
+    pool.run(bands, [&](size_t b, unsigned) {
+        uint32_t r0 = (uint32_t)b * BAND_ROWS, r1 = std::min(r0 + BAND_ROWS, w.rows);
+        w.clearRows(r0, r1);
+        std::copy(cells.begin() + w.rowStart(r0), cells.begin() + w.rowStart(r1), w.entity_grid.begin() + w.rowStart(r0));
+    });
+}
+
+//Custos medidos pelo microbenchmark de calibracao (nanossegundos)
+struct tick_cost_t
+{
+    double cell_ns = 0;
+    double entity_ns = 0;
+    double dispatch_ns = 0;
+};
+
+//Escolhe, a cada tick, entre o kernel sequencial e o tick paralelo. O custo de
+//um tick e estimado por celulas * cell_ns + seres vivos * entity_ns; o caminho
+//paralelo divide esse custo pelas threads uteis mas paga tres despachos do
+//pool. Os custos sao medidos uma vez na partida por calibrate(); a populacao
+//viva vem dos contadores do mundo, entao a escolha e refeita a cada tick.
+class adaptive_ticker_t
+{
+public:
+    explicit adaptive_ticker_t(unsigned threads, bool pinned = false) : pool(threads, pinned) {}
+
+    unsigned threads() const { return pool.size(); }
+    const tick_cost_t &cost() const { return costs; }
+    uint64_t serialTicks() const { return serial_ticks; }
+    uint64_t parallelTicks() const { return parallel_ticks; }
+
+    //Realoca a grade de w com o primeiro toque feito pelas threads do pool
+    void place(world_t &w) { placeWorld(w, pool); }
+
+    void calibrate()
+    {
+        if (pool.size() == 1) return;
+        const uint32_t side = 128, ticks = 8;
+
+        world_t w(side, side);
+        w.reset(1);
+        costs.cell_ns = timeTicks(w, ticks) / ((double)side * side);
+
+        w.reset(1);
+        uint32_t live = side * side / 2;
+        startEcoSim(w, live * 3 / 4, live / 5, live - live * 3 / 4 - live / 5);
+        double busy = timeTicks(w, ticks) - costs.cell_ns * side * side;
+        costs.entity_ns = std::max(busy, 0.0) / live;
+
+        const int rounds = 200;
+        auto begin = std::chrono::steady_clock::now();
+        for (int r = 0; r < rounds; r++) pool.run(pool.size(), [](size_t, unsigned) {});
+        costs.dispatch_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / rounds;
+    }
+
+    //O tick paralelo compensa para este mundo?
+    bool parallel(const world_t &w, uint64_t live) const
+    {
+        if (pool.size() == 1) return false;
+        unsigned useful = (unsigned)std::min<size_t>(pool.size(), (w.rows + BAND_ROWS - 1) / BAND_ROWS);
+        double serial = (double)w.rows * w.cols * costs.cell_ns + live * costs.entity_ns;
+        return serial / useful + 3 * costs.dispatch_ns < serial;
+    }
+
+    void step(world_t &w, entity_tracker_t *tracker = nullptr)
+    {
+        const population_t &pop = w.population;
+        if (parallel(w, (uint64_t)pop.plants + pop.herbivores + pop.carnivores))
+        {
+            nextIterationParallel(w, pool, tracker);
+            parallel_ticks++;
+        }
+        else
+        {
+            if (tracker)
+                nextIterationTracked(w, *tracker);
+            else
+                nextIteration(w);
+            serial_ticks++;
+        }
+    }
+
+private:
+    //Tempo medio (ns) de um tick sequencial sobre uma copia de w
+    static double timeTicks(const world_t &w, uint32_t ticks)
+    {
+        world_t copy = w;
+        auto begin = std::chrono::steady_clock::now();
+        for (uint32_t t = 0; t < ticks; t++) nextIteration(copy);
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / ticks;
+    }
+
+    thread_pool_t pool;
+    tick_cost_t costs;
+    uint64_t serial_ticks = 0;
+    uint64_t parallel_ticks = 0;
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "subdomain.hpp"
+
+#include <algorithm>
+#include <vector>
+
+//Lado (em celulas) dos ladrilhos usados para medir a carga e repartir o mundo
+const uint32_t BALANCE_TILE = 16;
+
+//Custo relativo de uma celula vazia em relacao a uma celula ocupada
+const double EMPTY_CELL_COST = 0.2;
+
+//Numeros do balanceamento, para relatorio
+struct balance_stats_t
+{
+    uint64_t checks = 0;
+    uint64_t rebalances = 0;
+    uint64_t migrated_cells = 0;
+    double migration_seconds = 0;
+    double last_imbalance = 1.0;
+    //Soma, em cada rebalanceamento, do ganho projetado para o periodo seguinte
+    //(tempo do mais lento menos a media, se a carga ficasse igual); nao e medido
+    double projected_seconds = 0;
+};
+
+//Mapa de carga por ladrilho (BALANCE_TILE x BALANCE_TILE celulas)
+struct load_map_t
+{
+    uint32_t tile_rows = 0;
+    uint32_t tile_cols = 0;
+    std::vector<double> cost;
+
+    void reset(uint32_t worldRows, uint32_t worldCols)
+    {
+        tile_rows = (worldRows + BALANCE_TILE - 1) / BALANCE_TILE;
+        tile_cols = (worldCols + BALANCE_TILE - 1) / BALANCE_TILE;
+        cost.assign((size_t)tile_rows * tile_cols, 0.0);
+    }
+
+    double &at(uint32_t ti, uint32_t tj) { return cost[(size_t)ti * tile_cols + tj]; }
+    double at(uint32_t ti, uint32_t tj) const { return cost[(size_t)ti * tile_cols + tj]; }
+};
+
+//Soma o custo das celulas proprias de um subdominio nos ladrilhos do mapa
+inline void accumulateLoad(const world_t &local, const rect_t &owned, load_map_t &map)
+{
+    for (int32_t i = owned.r0; i < owned.r1; i++)
+    {
+        for (int32_t j = owned.c0; j < owned.c1; j++)
+        {
+            double c = cellType(local.at(i - local.row0, j - local.col0)) == entity_type_t::empty ? EMPTY_CELL_COST : 1.0;
+            map.at(i / BALANCE_TILE, j / BALANCE_TILE) += c;
+        }
+    }
+}
+
+namespace balance
+{
+    inline double regionCost(const load_map_t &map, uint32_t tr0, uint32_t tr1, uint32_t tc0, uint32_t tc1)
+    {
+        double s = 0;
+        for (uint32_t ti = tr0; ti < tr1; ti++)
+        {
+            for (uint32_t tj = tc0; tj < tc1; tj++) s += map.at(ti, tj);
+        }
+        return s;
+    }
+
+    //Bissecao recursiva: corta a regiao (em ladrilhos) na dimensao maior, no
+    //ponto em que o custo a esquerda fica proporcional ao numero de partes dela
+    inline void bisect(const load_map_t &map, uint32_t tr0, uint32_t tr1, uint32_t tc0, uint32_t tc1, size_t parts,
+                       uint32_t worldRows, uint32_t worldCols, std::vector<rect_t> &out)
+    {
+        bool rowsCut = (tr1 - tr0) >= (tc1 - tc0);
+        uint32_t lo = rowsCut ? tr0 : tc0, hi = rowsCut ? tr1 : tc1;
+        if (parts == 1)
+        {
+            out.push_back({(int32_t)std::min(tr0 * BALANCE_TILE, worldRows), (int32_t)std::min(tc0 * BALANCE_TILE, worldCols),
+                           (int32_t)std::min(tr1 * BALANCE_TILE, worldRows), (int32_t)std::min(tc1 * BALANCE_TILE, worldCols)});
+            return;
+        }
+
+        size_t left = parts / 2;
+        double total = regionCost(map, tr0, tr1, tc0, tc1);
+        double target = total * left / parts;
+
+        uint32_t cut = lo + 1;
+        double acc = 0;
+        for (uint32_t c = lo; c + 1 < hi; c++)
+        {
+            double slice = rowsCut ? regionCost(map, c, c + 1, tc0, tc1) : regionCost(map, tr0, tr1, c, c + 1);
+            if (acc + slice / 2 > target) break;
+            acc += slice;
+            cut = c + 1;
+        }
+
+        //Cada lado precisa de pelo menos um ladrilho por parte: em regioes
+        //pequenas, o numero de partes de cada lado segue o numero de ladrilhos
+        size_t other = rowsCut ? tc1 - tc0 : tr1 - tr0;
+        size_t leftTiles = (cut - lo) * other, rightTiles = (hi - cut) * other;
+        left = std::max(left, parts > rightTiles ? parts - rightTiles : (size_t)1);
+        left = std::min(left, std::min(leftTiles, parts - 1));
+
+        if (rowsCut)
+        {
+            bisect(map, tr0, cut, tc0, tc1, left, worldRows, worldCols, out);
+            bisect(map, cut, tr1, tc0, tc1, parts - left, worldRows, worldCols, out);
+        }
+        else
+        {
+            bisect(map, tr0, tr1, tc0, cut, left, worldRows, worldCols, out);
+            bisect(map, tr0, tr1, cut, tc1, parts - left, worldRows, worldCols, out);
+        }
+    }
+}
+
+//Nova particao com parts retangulos de custo aproximadamente igual (o mapa
+//precisa ter pelo menos parts ladrilhos)
+inline std::vector<rect_t> bisectLayout(const load_map_t &map, size_t parts, uint32_t worldRows, uint32_t worldCols)
+{
+    std::vector<rect_t> layout;
+    balance::bisect(map, 0, map.tile_rows, 0, map.tile_cols, parts, worldRows, worldCols, layout);
+    return layout;
+}
+
+//Celulas que mudam de dono entre duas particoes
+inline uint64_t movedCells(const std::vector<rect_t> &before, const std::vector<rect_t> &after)
+{
+    uint64_t kept = 0;
+    for (size_t k = 0; k < before.size() && k < after.size(); k++) kept += intersect(before[k], after[k]).area();
+
+    uint64_t total = 0;
+    for (const rect_t &r : before) total += r.area();
+    return total - kept;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "trajectory.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//Reproducao de uma trajetoria gravada para varios clientes ao mesmo tempo.
+//Cada cursor tem o seu leitor (descritor proprio, leituras com pread) e o seu
+//mundo; um pedido de quadro usa o cursor livre que chega ao tick com menos
+//deltas: quem esta tocando a trajetoria em sequencia reaproveita o cursor que
+//parou no tick anterior e decodifica um unico delta, e uma busca distante
+//parte do quadro-chave anterior. Nada e simulado de novo.
+class replay_pool_t
+{
+public:
+    replay_pool_t(const std::string &path, unsigned cursors)
+    {
+        for (unsigned k = 0; k < std::max(cursors, 1u); k++)
+        {
+            pool.emplace_back(new cursor_t());
+            pool.back()->reader.open(path);
+        }
+    }
+
+    const trajectory_reader_t &info() const { return pool.front()->reader; }
+    size_t cursors() const { return pool.size(); }
+
+    //Chama use(mundo) com o estado do tick, com o cursor travado
+    template <class F>
+    void frame(uint64_t tick, F &&use)
+    {
+        const trajectory_reader_t &r = info();
+        if (tick < r.firstTick() || tick > r.lastTick()) throw std::out_of_range("tick " + std::to_string(tick) + " is not in the trajectory");
+        uint64_t key = r.keyframeBefore(tick);
+
+        //Cursores em ordem de custo: deltas a decodificar a partir de onde parou,
+        //ou do quadro-chave (que custa como varios deltas)
+        std::vector<std::pair<uint64_t, cursor_t *>> order;
+        for (const std::unique_ptr<cursor_t> &c : pool)
+        {
+            uint64_t at = c->tick.load(std::memory_order_relaxed);
+            bool resume = c->ready.load(std::memory_order_relaxed) && at <= tick && at >= key;
+            order.emplace_back(resume ? tick - at : tick - key + KEYFRAME_COST, c.get());
+        }
+        std::sort(order.begin(), order.end(), [](const std::pair<uint64_t, cursor_t *> &a, const std::pair<uint64_t, cursor_t *> &b) { return a.first < b.first; });
+
+        cursor_t *chosen = nullptr;
+        for (const std::pair<uint64_t, cursor_t *> &o : order)
+        {
+            if (o.second->mtx.try_lock())
+            {
+                chosen = o.second;
+                break;
+            }
+        }
+        if (!chosen)
+        {
+            chosen = order.front().second;
+            chosen->mtx.lock();
+        }
+        std::lock_guard<std::mutex> lock(chosen->mtx, std::adopt_lock);
+        chosen->ready.store(false, std::memory_order_relaxed);
+        chosen->reader.seek(tick, chosen->world);
+        chosen->tick.store(tick, std::memory_order_relaxed);
+        chosen->ready.store(true, std::memory_order_relaxed);
+        use(static_cast<const world_t &>(chosen->world));
+    }
+
+private:
+    //Peso de partir de um quadro-chave, em deltas
+    static const uint64_t KEYFRAME_COST = 4;
+
+    struct cursor_t
+    {
+        std::mutex mtx;
+        trajectory_reader_t reader;
+        world_t world;
+        std::atomic<uint64_t> tick{0};
+        std::atomic<bool> ready{false};
+    };
+
+    std::vector<std::unique_ptr<cursor_t>> pool;
+};
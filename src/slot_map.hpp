@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+//Referencia de 32 bits a um elemento de um slot_map_t: indice do slot (24 bits)
+//e geracao do slot (8 bits). A geracao 0 nunca e usada, entao o valor 0 e o
+//handle nulo.
+struct handle_t
+{
+    uint32_t bits;
+
+    uint32_t index() const { return bits & 0xFFFFFF; }
+    uint32_t generation() const { return bits >> 24; }
+    bool null() const { return bits == 0; }
+};
+
+const handle_t NULL_HANDLE = {0};
+
+//Mapa de slots com geracao: insercao, remocao e acesso em O(1). Ao remover, a
+//geracao do slot avanca e handles antigos passam a ser detectados como velhos
+//(a geracao tem 8 bits e da a volta depois de 255 reusos do mesmo slot).
+template <typename T>
+class slot_map_t
+{
+public:
+    static const uint32_t MAX_SLOTS = 1u << 24;
+
+    void clear()
+    {
+        values.clear();
+        generations.clear();
+        free_slots.clear();
+        live = 0;
+    }
+
+    void reserve(size_t n)
+    {
+        values.reserve(n);
+        generations.reserve(n);
+        free_slots.reserve(n);
+    }
+
+    handle_t insert(const T &value)
+    {
+        uint32_t slot;
+        if (!free_slots.empty())
+        {
+            slot = free_slots.back();
+            free_slots.pop_back();
+            values[slot] = value;
+        }
+        else
+        {
+            if (values.size() == MAX_SLOTS) throw std::length_error("slot map is full");
+            slot = (uint32_t)values.size();
+            values.push_back(value);
+            generations.push_back(1);
+        }
+        live++;
+        return {slot | ((uint32_t)generations[slot] << 24)};
+    }
+
+    bool erase(handle_t h)
+    {
+        if (!contains(h)) return false;
+        uint8_t &g = generations[h.index()];
+        g = g == 0xFF ? 1 : g + 1;
+        free_slots.push_back(h.index());
+        live--;
+        return true;
+    }
+
+    bool contains(handle_t h) const
+    {
+        return !h.null() && h.index() < values.size() && generations[h.index()] == h.generation();
+    }
+
+    //Ponteiro para o valor, ou nullptr se o handle e nulo ou velho
+    T *get(handle_t h) { return contains(h) ? &values[h.index()] : nullptr; }
+    const T *get(handle_t h) const { return contains(h) ? &values[h.index()] : nullptr; }
+
+    size_t size() const { return live; }
+
+private:
+    std::vector<T> values;
+    std::vector<uint8_t> generations;
+    std::vector<uint32_t> free_slots;
+    size_t live = 0;
+};
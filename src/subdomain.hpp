@@ -0,0 +1,270 @@
+#pragma once
+
+#include "ecosim.hpp"
+
+#include <algorithm>
+#include <vector>
+
+//Retangulo [r0, r1) x [c0, c1) em coordenadas globais da grade
+struct rect_t
+{
+    int32_t r0 = 0;
+    int32_t c0 = 0;
+    int32_t r1 = 0;
+    int32_t c1 = 0;
+
+    uint32_t rows() const { return r1 > r0 ? r1 - r0 : 0; }
+    uint32_t cols() const { return c1 > c0 ? c1 - c0 : 0; }
+    size_t area() const { return (size_t)rows() * cols(); }
+    bool empty() const { return area() == 0; }
+};
+
+inline rect_t intersect(const rect_t &a, const rect_t &b)
+{
+    return {std::max(a.r0, b.r0), std::max(a.c0, b.c0), std::min(a.r1, b.r1), std::min(a.c1, b.c1)};
+}
+
+//Retangulo aumentado de h celulas em cada lado, limitado as bordas do mundo
+inline rect_t expand(const rect_t &r, uint32_t h, uint32_t worldRows, uint32_t worldCols)
+{
+    return {std::max<int32_t>(r.r0 - (int32_t)h, 0), std::max<int32_t>(r.c0 - (int32_t)h, 0),
+            std::min<int32_t>(r.r1 + (int32_t)h, worldRows), std::min<int32_t>(r.c1 + (int32_t)h, worldCols)};
+}
+
+//Divide o mundo em pr x pc subdominios retangulares de tamanho quase igual
+inline std::vector<rect_t> partitionGrid(uint32_t rows, uint32_t cols, uint32_t pr, uint32_t pc)
+{
+    std::vector<rect_t> parts;
+    for (uint32_t a = 0; a < pr; a++)
+    {
+        for (uint32_t b = 0; b < pc; b++)
+        {
+            parts.push_back({(int32_t)(rows * a / pr), (int32_t)(cols * b / pc), (int32_t)(rows * (a + 1) / pr), (int32_t)(cols * (b + 1) / pc)});
+        }
+    }
+    return parts;
+}
+
+//Retangulo da janela coberta por um world_t
+inline rect_t windowOf(const world_t &w)
+{
+    return {w.row0, w.col0, w.row0 + (int32_t)w.rows, w.col0 + (int32_t)w.cols};
+}
+
+//Copia as celulas de r (coordenadas globais, dentro da janela de w) para out,
+//em ordem de linhas. Linhas inteiras quando a grade e row-major.
+inline void packRect(const world_t &w, const rect_t &r, cell_t *out)
+{
+    for (int32_t i = r.r0; i < r.r1; i++)
+    {
+        if (w.layout == layout_row_major)
+        {
+            const cell_t *row = &w.at(i - w.row0, r.c0 - w.col0);
+            out = std::copy(row, row + r.cols(), out);
+            continue;
+        }
+        for (int32_t j = r.c0; j < r.c1; j++) *out++ = w.at(i - w.row0, j - w.col0);
+    }
+}
+
+inline void unpackRect(world_t &w, const rect_t &r, const cell_t *in)
+{
+    for (int32_t i = r.r0; i < r.r1; i++)
+    {
+        if (w.layout == layout_row_major)
+        {
+            std::copy(in, in + r.cols(), &w.at(i - w.row0, r.c0 - w.col0));
+            in += r.cols();
+            continue;
+        }
+        for (int32_t j = r.c0; j < r.c1; j++) w.at(i - w.row0, j - w.col0) = *in++;
+    }
+}
+
+//Copia as celulas de r (coordenadas globais) de uma janela para outra
+inline void copyRect(const world_t &from, world_t &to, const rect_t &r)
+{
+    for (int32_t i = r.r0; i < r.r1; i++)
+    {
+        if (from.layout == layout_row_major && to.layout == layout_row_major)
+        {
+            const cell_t *src = &from.at(i - from.row0, r.c0 - from.col0);
+            std::copy(src, src + r.cols(), &to.at(i - to.row0, r.c0 - to.col0));
+            continue;
+        }
+        for (int32_t j = r.c0; j < r.c1; j++) to.at(i - to.row0, j - to.col0) = from.at(i - from.row0, j - from.col0);
+    }
+}
+
+//Conta os seres de r (coordenadas globais, dentro da janela de w)
+inline population_t countRect(const world_t &w, const rect_t &r)
+{
+    population_t pop;
+    for (int32_t i = r.r0; i < r.r1; i++)
+    {
+        for (int32_t j = r.c0; j < r.c1; j++)
+        {
+            entity_type_t type = cellType(w.at(i - w.row0, j - w.col0));
+            pop.plants += type == entity_type_t::plant;
+            pop.herbivores += type == entity_type_t::herbivore;
+            pop.carnivores += type == entity_type_t::carnivore;
+        }
+    }
+    return pop;
+}
+
+//Chama visit com a parte dentro de owned (coordenadas globais) de cada
+//ladrilho sujo de local e limpa as marcas de local
+template <class F>
+inline void takeDirty(world_t &local, const rect_t &owned, F &&visit)
+{
+    const int32_t side = 1 << DIRTY_TILE_BITS;
+    for (size_t t = 0; t < local.dirty.size(); t++)
+    {
+        if (!local.dirty[t]) continue;
+        local.dirty[t] = 0;
+        int32_t i0 = local.row0 + (int32_t)(t / local.dirty_cols) * side, j0 = local.col0 + (int32_t)(t % local.dirty_cols) * side;
+        rect_t r = intersect({i0, j0, i0 + side, j0 + side}, owned);
+        if (!r.empty()) visit(r);
+    }
+}
+
+//Marca em w os ladrilhos de r (coordenadas globais, dentro da janela de w),
+//que vem de um ladrilho de outra janela: ele cobre no maximo 2x2 ladrilhos de
+//w, entao basta marcar os cantos
+inline void touchRect(world_t &w, const rect_t &r)
+{
+    w.touch(r.r0 - w.row0, r.c0 - w.col0);
+    w.touch(r.r0 - w.row0, r.c1 - 1 - w.col0);
+    w.touch(r.r1 - 1 - w.row0, r.c0 - w.col0);
+    w.touch(r.r1 - 1 - w.row0, r.c1 - 1 - w.col0);
+}
+
+//Passa para world as marcas de ladrilhos sujos das celulas de owned e limpa
+//as de local
+inline void mergeDirty(world_t &local, const rect_t &owned, world_t &world)
+{
+    takeDirty(local, owned, [&](const rect_t &r) { touchRect(world, r); });
+}
+
+//Largura do halo que permite avancar exchangeTicks ticks sem trocar dados:
+//a cada tick a regiao valida encolhe TICK_RADIUS celulas
+inline uint32_t haloWidth(uint32_t exchangeTicks)
+{
+    return exchangeTicks * TICK_RADIUS;
+}
+
+//Pedaco do mundo simulado por um processo ou thread: celulas proprias mais uma
+//borda (halo) copiada dos vizinhos. Com halo de exchange_ticks * TICK_RADIUS
+//celulas, o subdominio avanca exchange_ticks ticks entre duas trocas,
+//recalculando de forma redundante a parte do halo que ainda e valida.
+struct subdomain_t
+{
+    uint32_t rank = 0;
+    rect_t owned;
+    rect_t extended;
+    world_t local;
+    uint32_t exchange_ticks = 1;
+    uint32_t since_exchange = 0;
+
+    void setup(uint32_t r, const rect_t &own, uint32_t exchangeTicks, uint32_t worldRows, uint32_t worldCols)
+    {
+        rank = r;
+        owned = own;
+        exchange_ticks = exchangeTicks;
+        since_exchange = 0;
+        extended = expand(own, haloWidth(exchangeTicks), worldRows, worldCols);
+        local.resizeWindow(extended.rows(), extended.cols(), extended.r0, extended.c0, worldRows, worldCols);
+    }
+
+    //O halo precisa ser atualizado antes do proximo tick?
+    bool haloStale() const { return since_exchange >= exchange_ticks; }
+
+    //Parte do buffer ainda valida: o halo perde TICK_RADIUS celulas por tick
+    //desde a ultima troca (nas bordas do mundo nao ha halo a perder)
+    rect_t validRegion() const
+    {
+        int32_t lost = (int32_t)(since_exchange * TICK_RADIUS);
+        return {std::min(extended.r0 + lost, owned.r0), std::min(extended.c0 + lost, owned.c0),
+                std::max(extended.r1 - lost, owned.r1), std::max(extended.c1 - lost, owned.c1)};
+    }
+
+    //Depois de carregar o buffer: a populacao de local passa a ser a das
+    //celulas proprias, mantida pelos eventos de cada tick
+    void countOwned()
+    {
+        local.population = countRect(local, owned);
+        local.last_counts = tick_counts_t();
+    }
+
+    //Avanca um tick calculando so a regiao valida; o resultado fica correto
+    //na regiao valida encolhida de TICK_RADIUS, que ainda contem as celulas proprias.
+    //So os eventos das celulas proprias entram na contagem: as do halo sao
+    //contadas pelo subdominio dono delas.
+    void step()
+    {
+        rect_t v = validRegion();
+        uint32_t r0 = v.r0 - extended.r0, r1 = v.r1 - extended.r0;
+        uint32_t c0 = v.c0 - extended.c0, c1 = v.c1 - extended.c0;
+        uint32_t or0 = owned.r0 - extended.r0, or1 = owned.r1 - extended.r0;
+        uint32_t oc0 = owned.c0 - extended.c0, oc1 = owned.c1 - extended.c0;
+        ecosim::decideRows(local, r0, r1, c0, c1);
+        ecosim::resolveRows(local, r0, r1, c0, c1);
+
+        tick_counts_t counts, halo;
+        ecosim::applyRows(local, counts, or0, or1, oc0, oc1);
+        ecosim::applyRows(local, halo, r0, or0, c0, c1);
+        ecosim::applyRows(local, halo, or1, r1, c0, c1);
+        ecosim::applyRows(local, halo, or0, or1, c0, oc0);
+        ecosim::applyRows(local, halo, or0, or1, oc1, c1);
+        ecosim::finishTick(local, counts);
+        since_exchange++;
+    }
+};
+
+//Troca de halo com outro subdominio: celulas proprias enviadas a ele e
+//celulas dele recebidas no meu halo
+struct halo_link_t
+{
+    uint32_t rank;
+    rect_t send;
+    rect_t recv;
+};
+
+inline std::vector<halo_link_t> haloLinks(const std::vector<rect_t> &layout, uint32_t rank, uint32_t exchangeTicks, uint32_t worldRows, uint32_t worldCols)
+{
+    std::vector<halo_link_t> links;
+    uint32_t halo = haloWidth(exchangeTicks);
+    rect_t mine = expand(layout[rank], halo, worldRows, worldCols);
+    for (uint32_t q = 0; q < layout.size(); q++)
+    {
+        if (q == rank) continue;
+        halo_link_t link{q, intersect(layout[rank], expand(layout[q], halo, worldRows, worldCols)), intersect(layout[q], mine)};
+        if (!link.send.empty() || !link.recv.empty()) links.push_back(link);
+    }
+    return links;
+}
+
+//Motor que divide o mundo em subdominios (threads ou processos)
+class partitioned_engine_t
+{
+public:
+    virtual ~partitioned_engine_t() = default;
+
+    //Distribui o estado de world entre os subdominios
+    virtual void load(const world_t &world) = 0;
+    //Avanca todos os subdominios; devolve o tick global atingido
+    virtual uint64_t step(uint32_t ticks) = 0;
+    //Monta o quadro completo em world (que deve ter as dimensoes do mundo)
+    virtual void gather(world_t &world) = 0;
+    //Copia para world so os ladrilhos em que alguma celula mudou de especie
+    //desde a ultima copia, com as marcas: basta para a piramide de densidade,
+    //mas energia e idade das outras celulas ficam atrasadas ate o proximo gather
+    virtual void gatherSpecies(world_t &world) = 0;
+    //Rodadas de troca de halo feitas desde o inicio
+    virtual uint64_t exchanges() const = 0;
+    //Populacao e eventos do ultimo tick, somados entre os subdominios sem
+    //montar o quadro
+    virtual population_t population() const = 0;
+    virtual tick_counts_t lastCounts() const = 0;
+};
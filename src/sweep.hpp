@@ -0,0 +1,296 @@
+#pragma once
+
+#include "ecosim.hpp"
+#include "thread_pool.hpp"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+//Um eixo da varredura: um parametro de species_params_t e os valores a testar
+struct sweep_axis_t
+{
+    std::string name;
+    std::vector<double> values;
+};
+
+struct sweep_config_t
+{
+    uint32_t rows = NUM_ROWS;
+    uint32_t cols = NUM_ROWS;
+    uint32_t plants = 10;
+    uint32_t herbivores = 5;
+    uint32_t carnivores = 2;
+    uint32_t ticks = 500;
+    uint32_t replicates = 4;
+    unsigned threads = std::thread::hardware_concurrency();
+    uint64_t seed = 1;
+    tick_rules_t rules = rules_original;
+    species_params_t base;
+    std::vector<sweep_axis_t> axes;
+};
+
+//Resultado de um job (ponto da grade de parametros x replica)
+struct sweep_result_t
+{
+    size_t point = 0;
+    uint32_t replicate = 0;
+    int32_t herbivore_extinction = -1;
+    int32_t carnivore_extinction = -1;
+    double mean_plants = 0;
+    double mean_herbivores = 0;
+    double mean_carnivores = 0;
+    double period = 0;
+};
+
+namespace sweep
+{
+    struct param_ref_t
+    {
+        const char *name;
+        const char *constant;
+        double species_params_t::*probability;
+        int32_t species_params_t::*integer;
+    };
+
+    static const param_ref_t PARAMS[] = {
+        {"plant_reproduction", "PLANT_REPRODUCTION_PROBABILITY", &species_params_t::plant_reproduction_probability, nullptr},
+        {"herbivore_reproduction", "HERBIVORE_REPRODUCTION_PROBABILITY", &species_params_t::herbivore_reproduction_probability, nullptr},
+        {"carnivore_reproduction", "CARNIVORE_REPRODUCTION_PROBABILITY", &species_params_t::carnivore_reproduction_probability, nullptr},
+        {"herbivore_move", "HERBIVORE_MOVE_PROBABILITY", &species_params_t::herbivore_move_probability, nullptr},
+        {"herbivore_eat", "HERBIVORE_EAT_PROBABILITY", &species_params_t::herbivore_eat_probability, nullptr},
+        {"carnivore_move", "CARNIVORE_MOVE_PROBABILITY", &species_params_t::carnivore_move_probability, nullptr},
+        {"carnivore_eat", "CARNIVORE_EAT_PROBABILITY", &species_params_t::carnivore_eat_probability, nullptr},
+        {"threshold_energy", "THRESHOLD_ENERGY_FOR_REPRODUCTION", nullptr, &species_params_t::threshold_energy_for_reproduction},
+    };
+
+    inline const param_ref_t &findParam(const std::string &name)
+    {
+        for (const param_ref_t &p : PARAMS)
+        {
+            if (name == p.name || name == p.constant) return p;
+        }
+        throw std::invalid_argument("unknown sweep parameter: " + name);
+    }
+
+    inline void setParam(species_params_t &params, const std::string &name, double value)
+    {
+        const param_ref_t &p = findParam(name);
+        if (p.probability) params.*p.probability = value;
+        else params.*p.integer = (int32_t)std::lround(value);
+    }
+
+    inline std::string trim(const std::string &s)
+    {
+        size_t b = 0, e = s.size();
+        while (b < e && std::isspace((unsigned char)s[b])) b++;
+        while (e > b && std::isspace((unsigned char)s[e - 1])) e--;
+        return s.substr(b, e - b);
+    }
+
+    //Le um eixo no formato "nome=inicio:fim:passo" ou "nome=v1,v2,v3"
+    inline sweep_axis_t parseAxis(const std::string &text)
+    {
+        size_t eq = text.find('=');
+        if (eq == std::string::npos) throw std::invalid_argument("expected name=values in '" + text + "'");
+
+        sweep_axis_t axis;
+        axis.name = trim(text.substr(0, eq));
+        findParam(axis.name);
+
+        std::string values = text.substr(eq + 1);
+        if (values.find(':') != std::string::npos)
+        {
+            double lo, hi, step;
+            if (std::sscanf(values.c_str(), "%lf:%lf:%lf", &lo, &hi, &step) != 3 || step <= 0 || hi < lo)
+                throw std::invalid_argument("bad range in '" + text + "'");
+            for (size_t k = 0; lo + k * step <= hi + step * 1e-9; k++) axis.values.push_back(lo + k * step);
+        }
+        else
+        {
+            size_t start = 0;
+            while (start <= values.size())
+            {
+                size_t comma = values.find(',', start);
+                if (comma == std::string::npos) comma = values.size();
+                axis.values.push_back(std::stod(values.substr(start, comma - start)));
+                start = comma + 1;
+            }
+        }
+        return axis;
+    }
+
+    //Le varios eixos separados por ';'
+    inline std::vector<sweep_axis_t> parseAxes(const std::string &spec)
+    {
+        std::vector<sweep_axis_t> axes;
+        size_t start = 0;
+        while (start < spec.size())
+        {
+            size_t semi = spec.find(';', start);
+            if (semi == std::string::npos) semi = spec.size();
+            std::string item = trim(spec.substr(start, semi - start));
+            if (!item.empty()) axes.push_back(parseAxis(item));
+            start = semi + 1;
+        }
+        return axes;
+    }
+
+    inline size_t pointCount(const sweep_config_t &config)
+    {
+        size_t n = 1;
+        for (const sweep_axis_t &axis : config.axes) n *= axis.values.size();
+        return n;
+    }
+
+    //Parametros do ponto k da grade cartesiana (o primeiro eixo varia mais devagar)
+    inline species_params_t pointParams(const sweep_config_t &config, size_t k)
+    {
+        species_params_t params = config.base;
+        for (size_t a = config.axes.size(); a-- > 0;)
+        {
+            const sweep_axis_t &axis = config.axes[a];
+            setParam(params, axis.name, axis.values[k % axis.values.size()]);
+            k /= axis.values.size();
+        }
+        return params;
+    }
+
+    inline uint64_t mixSeed(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    //Periodo dominante da serie pela autocorrelacao: primeiro pico depois que ela fica negativa
+    inline double oscillationPeriod(const std::vector<double> &series, size_t n)
+    {
+        if (n < 4) return 0;
+
+        double mean = 0;
+        for (size_t t = 0; t < n; t++) mean += series[t];
+        mean /= n;
+
+        double var = 0;
+        for (size_t t = 0; t < n; t++) var += (series[t] - mean) * (series[t] - mean);
+        if (var == 0) return 0;
+
+        auto acf = [&](size_t lag) {
+            double s = 0;
+            for (size_t t = 0; t + lag < n; t++) s += (series[t] - mean) * (series[t + lag] - mean);
+            return s / var;
+        };
+
+        bool negative = false;
+        double prev = acf(1), cur = acf(2);
+        for (size_t lag = 2; lag + 1 < n / 2; lag++)
+        {
+            double following = acf(lag + 1);
+            if (cur < 0) negative = true;
+            if (negative && cur > 0 && cur >= prev && cur >= following) return (double)lag;
+            prev = cur;
+            cur = following;
+        }
+        return 0;
+    }
+
+    //Buffers de cada thread, alocados uma unica vez e reaproveitados por todos os jobs
+    struct sweep_buffers_t
+    {
+        world_t world;
+        std::vector<double> herbivores;
+    };
+
+    inline sweep_result_t runJob(const sweep_config_t &config, size_t job, sweep_buffers_t &buf)
+    {
+        sweep_result_t result;
+        result.point = job / config.replicates;
+        result.replicate = (uint32_t)(job % config.replicates);
+
+        world_t &w = buf.world;
+        w.params = pointParams(config, result.point);
+        w.reset(mixSeed(config.seed ^ mixSeed(job)));
+        startEcoSim(w, config.plants, config.herbivores, config.carnivores);
+
+        for (uint32_t tick = 1; tick <= config.ticks; tick++)
+        {
+            if (config.rules == rules_original)
+                nextIterationOriginal(w);
+            else
+                nextIteration(w);
+            const population_t &pop = w.population;
+
+            result.mean_plants += pop.plants;
+            result.mean_herbivores += pop.herbivores;
+            result.mean_carnivores += pop.carnivores;
+            buf.herbivores[tick - 1] = pop.herbivores;
+
+            if (pop.herbivores == 0 && result.herbivore_extinction < 0) result.herbivore_extinction = tick;
+            if (pop.carnivores == 0 && result.carnivore_extinction < 0) result.carnivore_extinction = tick;
+        }
+
+        if (config.ticks > 0)
+        {
+            result.mean_plants /= config.ticks;
+            result.mean_herbivores /= config.ticks;
+            result.mean_carnivores /= config.ticks;
+        }
+        result.period = oscillationPeriod(buf.herbivores, config.ticks);
+        return result;
+    }
+}
+
+//Executa todos os jobs (pontos x replicas) distribuidos no pool de threads
+inline std::vector<sweep_result_t> runSweep(const sweep_config_t &config)
+{
+    if ((uint64_t)config.plants + config.herbivores + config.carnivores > (uint64_t)config.rows * config.cols)
+        throw std::invalid_argument("Too many entities");
+
+    size_t jobs = sweep::pointCount(config) * config.replicates;
+    std::vector<sweep_result_t> results(jobs);
+
+    thread_pool_t pool(config.threads);
+    std::vector<sweep::sweep_buffers_t> buffers(pool.size());
+    for (sweep::sweep_buffers_t &buf : buffers)
+    {
+        buf.world.resize(config.rows, config.cols);
+        buf.herbivores.assign(config.ticks, 0.0);
+    }
+
+    pool.run(jobs, [&](size_t job, unsigned thread) {
+        results[job] = sweep::runJob(config, job, buffers[thread]);
+    });
+    return results;
+}
+
+//Escreve a tabela de resultados em CSV, uma linha por job
+inline void writeSweepTable(std::ostream &out, const sweep_config_t &config, const std::vector<sweep_result_t> &results)
+{
+    out << "point,replicate";
+    for (const sweep_axis_t &axis : config.axes) out << ',' << axis.name;
+    out << ",herbivore_extinction,carnivore_extinction,mean_plants,mean_herbivores,mean_carnivores,period\n";
+
+    char line[256];
+    for (const sweep_result_t &r : results)
+    {
+        out << r.point << ',' << r.replicate;
+        size_t k = r.point;
+        std::vector<double> coords(config.axes.size());
+        for (size_t a = config.axes.size(); a-- > 0;)
+        {
+            coords[a] = config.axes[a].values[k % config.axes[a].values.size()];
+            k /= config.axes[a].values.size();
+        }
+        for (double v : coords) out << ',' << v;
+
+        std::snprintf(line, sizeof(line), ",%d,%d,%.3f,%.3f,%.3f,%.1f\n", r.herbivore_extinction, r.carnivore_extinction,
+                      r.mean_plants, r.mean_herbivores, r.mean_carnivores, r.period);
+        out << line;
+    }
+}
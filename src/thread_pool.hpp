@@ -0,0 +1,212 @@
+#pragma once
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Topologia lida de /sys: CPUs permitidas agrupadas por no NUMA
+namespace topology
+{
+    //Lista no formato "0-3,8,10-11"
+    inline std::vector<int> parseCpuList(const std::string &text)
+    {
+        std::vector<int> cpus;
+        std::stringstream in(text);
+        std::string range;
+        while (std::getline(in, range, ','))
+        {
+            if (range.empty() || range[0] < '0' || range[0] > '9') continue;
+            size_t dash = range.find('-');
+            int lo = std::atoi(range.c_str()), hi = dash == std::string::npos ? lo : std::atoi(range.c_str() + dash + 1);
+            for (int c = lo; c <= hi; c++) cpus.push_back(c);
+        }
+        return cpus;
+    }
+
+    //No NUMA de uma CPU (0 sem informacao de NUMA)
+    inline int nodeOfCpu(int cpu)
+    {
+        std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+        DIR *d = opendir(dir.c_str());
+        if (!d) return 0;
+        int node = 0;
+        while (dirent *e = readdir(d))
+        {
+            if (std::string(e->d_name).compare(0, 4, "node") == 0) node = std::atoi(e->d_name + 4);
+        }
+        closedir(d);
+        return node;
+    }
+
+    //CPUs em que o processo pode rodar, ordenadas por no: threads vizinhas no
+    //pool ficam no mesmo no
+    inline std::vector<int> cpusByNode()
+    {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) return {0};
+
+        std::vector<int> cpus;
+        for (int node = 0;; node++)
+        {
+            std::ifstream list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            if (!list) break;
+            std::string text;
+            std::getline(list, text);
+            for (int c : parseCpuList(text))
+            {
+                if (CPU_ISSET(c, &allowed)) cpus.push_back(c);
+            }
+        }
+        if (cpus.empty())
+        {
+            for (int c = 0; c < CPU_SETSIZE; c++)
+            {
+                if (CPU_ISSET(c, &allowed)) cpus.push_back(c);
+            }
+        }
+        return cpus;
+    }
+}
+
+//Conjunto fixo de threads que executa lotes de tarefas numeradas.
+//Cada tarefa recebe (indice da tarefa, indice da thread), permitindo que
+//cada thread reaproveite seus proprios buffers entre tarefas.
+//
+//Com pinned, cada thread fica presa a uma CPU (agrupadas por no NUMA) e as
+//tarefas sao divididas em blocos contiguos fixos: a tarefa k sempre roda na
+//mesma thread, entao a memoria que ela toca primeiro fica no no dessa thread.
+//A thread chamadora so espera, ja que pode ser qualquer thread do servidor.
+class thread_pool_t
+{
+public:
+    explicit thread_pool_t(unsigned threads = std::thread::hardware_concurrency(), bool pin = false) : pinned(pin)
+    {
+        if (threads == 0) threads = 1;
+        if (pinned)
+        {
+            std::vector<int> cpus = topology::cpusByNode();
+            for (unsigned t = 0; t < threads; t++) cpu_of.push_back(cpus[t % cpus.size()]);
+        }
+        for (unsigned t = pinned ? 0 : 1; t < threads; t++) workers.emplace_back([this, t] { workerLoop(t); });
+    }
+
+    ~thread_pool_t()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            stopping = true;
+            generation++;
+        }
+        start.notify_all();
+        for (auto &th : workers) th.join();
+    }
+
+    thread_pool_t(const thread_pool_t &) = delete;
+    thread_pool_t &operator=(const thread_pool_t &) = delete;
+
+    unsigned size() const { return (unsigned)workers.size() + (pinned ? 0 : 1); }
+    bool isPinned() const { return pinned; }
+
+    //CPU da thread (-1 sem pinned)
+    int cpuOf(unsigned thread) const { return pinned ? cpu_of[thread] : -1; }
+
+    //Thread que executa a tarefa k de um lote de tasks com pinned
+    unsigned ownerOf(size_t k, size_t tasks) const
+    {
+        unsigned t = 0;
+        while ((t + 1) * tasks / size() <= k) t++;
+        return t;
+    }
+
+    //Executa task(k, thread) para k em [0, tasks); sem pinned a thread chamadora tambem trabalha
+    void run(size_t tasks, const std::function<void(size_t, unsigned)> &task)
+    {
+        if (tasks == 0) return;
+        if (!pinned && (workers.empty() || tasks == 1))
+        {
+            for (size_t k = 0; k < tasks; k++) task(k, 0);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            current = &task;
+            total = tasks;
+            next.store(0);
+            busy = (unsigned)workers.size();
+            generation++;
+        }
+        start.notify_all();
+
+        if (!pinned) drain(0);
+
+        std::unique_lock<std::mutex> lock(mtx);
+        done.wait(lock, [this] { return busy == 0; });
+        current = nullptr;
+    }
+
+private:
+    void drain(unsigned thread)
+    {
+        if (pinned)
+        {
+            size_t n = size();
+            for (size_t k = thread * total / n; k < (thread + 1) * total / n; k++) (*current)(k, thread);
+            return;
+        }
+        for (size_t k = next.fetch_add(1); k < total; k = next.fetch_add(1)) (*current)(k, thread);
+    }
+
+    void workerLoop(unsigned thread)
+    {
+        if (pinned)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu_of[thread], &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+
+        uint64_t seen = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                start.wait(lock, [&] { return generation != seen; });
+                seen = generation;
+                if (stopping) return;
+            }
+
+            drain(thread);
+
+            std::lock_guard<std::mutex> lock(mtx);
+            if (--busy == 0) done.notify_one();
+        }
+    }
+
+    bool pinned;
+    std::vector<int> cpu_of;
+    std::vector<std::thread> workers;
+    std::mutex mtx;
+    std::condition_variable start;
+    std::condition_variable done;
+    const std::function<void(size_t, unsigned)> *current = nullptr;
+    std::atomic<size_t> next{0};
+    size_t total = 0;
+    unsigned busy = 0;
+    uint64_t generation = 0;
+    bool stopping = false;
+};
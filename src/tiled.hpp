@@ -0,0 +1,230 @@
+#pragma once
+
+#include "rebalance.hpp"
+#include "subdomain.hpp"
+#include "thread_pool.hpp"
+
+#include <chrono>
+#include <vector>
+
+//Motor em um unico processo: cada subdominio tem seu proprio buffer com halo e
+//e avancado por uma thread do pool. A troca de halo e uma copia direta entre
+//buffers, feita a cada exchange_ticks ticks; entre trocas as threads nao se
+//sincronizam. Opcionalmente a particao e refeita conforme a carga medida.
+class tiled_engine_t : public partitioned_engine_t
+{
+public:
+    //Com pinned, cada subdominio e alocado, inicializado e avancado sempre pela
+    //mesma thread, presa a uma CPU: o buffer dele fica no no NUMA dessa thread
+    tiled_engine_t(const std::vector<rect_t> &parts, uint32_t exchangeTicks, unsigned threads, bool pinned = false)
+        : layout(parts), exchange_ticks(exchangeTicks), pool(threads, pinned), subs(parts.size())
+    {
+    }
+
+    uint64_t exchanges() const override { return exchange_rounds; }
+
+    population_t population() const override
+    {
+        population_t pop;
+        for (const subdomain_t &sub : subs) pop += sub.local.population;
+        return pop;
+    }
+
+    tick_counts_t lastCounts() const override
+    {
+        tick_counts_t sum;
+        for (const subdomain_t &sub : subs) sum += sub.local.last_counts;
+        return sum;
+    }
+    const std::vector<subdomain_t> &subdomains() const { return subs; }
+    const std::vector<rect_t> &partition() const { return layout; }
+    const balance_stats_t &balanceStats() const { return balance_stats; }
+
+    //A cada every ticks compara o tempo de cada subdominio; se o mais lento
+    //passa de threshold vezes a media e o ganho esperado no proximo periodo
+    //paga o custo da ultima migracao, reparte o mundo por bissecao recursiva
+    //do custo medido por ladrilho e migra as celulas para os novos donos
+    void enableRebalance(uint32_t every, double threshold)
+    {
+        rebalance_every = every;
+        rebalance_threshold = threshold;
+    }
+
+    void load(const world_t &world) override
+    {
+        world_rows = world.rows;
+        world_cols = world.cols;
+        for (uint32_t k = 0; !configured && k < subs.size(); k++) links.push_back(haloLinks(layout, k, exchange_ticks, world.rows, world.cols));
+        pool.run(subs.size(), [&](size_t k, unsigned) {
+            subdomain_t &sub = subs[k];
+            if (!configured) sub.setup((uint32_t)k, layout[k], exchange_ticks, world.rows, world.cols);
+            sub.local.params = world.params;
+            sub.local.seed = world.seed;
+            sub.local.tick = world.tick;
+            sub.since_exchange = 0;
+            packRect(world, sub.extended, sub.local.entity_grid.data());
+            sub.countOwned();
+        });
+        configured = true;
+        tick = world.tick;
+        busy.assign(subs.size(), 0.0);
+        since_check = 0;
+    }
+
+    uint64_t step(uint32_t ticks) override
+    {
+        while (ticks > 0)
+        {
+            if (subs[0].haloStale())
+            {
+                pool.run(subs.size(), [this](size_t k, unsigned) { pullHalo((uint32_t)k); });
+                exchange_rounds++;
+            }
+
+            uint32_t burst = std::min(ticks, subs[0].exchange_ticks - subs[0].since_exchange);
+            if (rebalance_every) burst = std::min(burst, rebalance_every - since_check);
+            pool.run(subs.size(), [this, burst](size_t k, unsigned) {
+                auto begin = std::chrono::steady_clock::now();
+                for (uint32_t t = 0; t < burst; t++) subs[k].step();
+                busy[k] += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            });
+            ticks -= burst;
+            tick += burst;
+            since_check += burst;
+            if (rebalance_every && since_check >= rebalance_every) checkBalance();
+        }
+        return tick;
+    }
+
+    //Copia as celulas proprias de cada subdominio direto para o mundo, com as
+    //marcas de ladrilhos que mudaram desde o ultimo quadro
+    void gather(world_t &world) override
+    {
+        for (subdomain_t &sub : subs)
+        {
+            copyRect(sub.local, world, sub.owned);
+            mergeDirty(sub.local, sub.owned, world);
+        }
+        world.tick = tick;
+        world.population = population();
+        world.last_counts = lastCounts();
+    }
+
+    void gatherSpecies(world_t &world) override
+    {
+        for (subdomain_t &sub : subs)
+        {
+            takeDirty(sub.local, sub.owned, [&](const rect_t &r) {
+                copyRect(sub.local, world, r);
+                touchRect(world, r);
+            });
+        }
+        world.tick = tick;
+        world.population = population();
+        world.last_counts = lastCounts();
+    }
+
+private:
+    void checkBalance()
+    {
+        balance_stats.checks++;
+        since_check = 0;
+
+        double slowest = *std::max_element(busy.begin(), busy.end()), mean = 0;
+        for (double b : busy) mean += b / busy.size();
+        std::fill(busy.begin(), busy.end(), 0.0);
+        balance_stats.last_imbalance = mean > 0 ? slowest / mean : 1.0;
+
+        map.reset(world_rows, world_cols);
+        if (balance_stats.last_imbalance < rebalance_threshold || map.cost.size() < subs.size()) return;
+
+        //Ganho esperado no proximo periodo se a carga ficar igual: as threads
+        //esperam pelo subdominio mais lento em cada troca
+        double expected = slowest - mean;
+        if (expected <= last_migration) return;
+
+        auto begin = std::chrono::steady_clock::now();
+        for (const subdomain_t &sub : subs) accumulateLoad(sub.local, sub.owned, map);
+        std::vector<rect_t> next = bisectLayout(map, subs.size(), world_rows, world_cols);
+        balance_stats.migrated_cells += movedCells(layout, next);
+        migrate(next);
+
+        last_migration = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        balance_stats.migration_seconds += last_migration;
+        balance_stats.projected_seconds += expected;
+        balance_stats.rebalances++;
+    }
+
+    //Passa para a particao next sem montar o mundo: o buffer novo de cada
+    //subdominio recebe so as celulas proprias dele, cada pedaco copiado do dono
+    //antigo (o proprio subdominio, para a parte que nao mudou de dono). O halo
+    //vem na troca seguinte, e as marcas de ladrilhos sujos ainda nao lidas
+    //passam para os novos donos.
+    void migrate(const std::vector<rect_t> &next)
+    {
+        std::vector<subdomain_t> moved(subs.size());
+        pool.run(subs.size(), [&](size_t k, unsigned) {
+            subdomain_t &sub = moved[k];
+            sub.setup((uint32_t)k, next[k], exchange_ticks, world_rows, world_cols);
+            sub.local.params = subs[k].local.params;
+            sub.local.seed = subs[k].local.seed;
+            sub.local.tick = subs[k].local.tick;
+            std::fill(sub.local.dirty.begin(), sub.local.dirty.end(), 0);
+            for (const subdomain_t &from : subs)
+            {
+                rect_t r = intersect(next[k], from.owned);
+                if (!r.empty()) copyRect(from.local, sub.local, r);
+            }
+            sub.countOwned();
+            sub.since_exchange = exchange_ticks;
+        });
+
+        //Os eventos do ultimo tick nao se dividem pela particao nova: o total
+        //fica com o primeiro subdominio
+        tick_counts_t last = lastCounts();
+        for (subdomain_t &from : subs)
+        {
+            takeDirty(from.local, from.owned, [&](const rect_t &r) {
+                for (subdomain_t &to : moved)
+                {
+                    rect_t x = intersect(r, to.owned);
+                    if (!x.empty()) touchRect(to.local, x);
+                }
+            });
+        }
+        subs.swap(moved);
+        subs[0].local.last_counts = last;
+
+        layout = next;
+        links.clear();
+        for (uint32_t k = 0; k < subs.size(); k++) links.push_back(haloLinks(layout, k, exchange_ticks, world_rows, world_cols));
+    }
+
+    //Copia para o halo do subdominio k as celulas proprias dos vizinhos. Cada
+    //thread so escreve no proprio halo e so le celulas proprias dos outros.
+    void pullHalo(uint32_t k)
+    {
+        subdomain_t &sub = subs[k];
+        for (const halo_link_t &link : links[k]) copyRect(subs[link.rank].local, sub.local, link.recv);
+        sub.since_exchange = 0;
+    }
+
+    std::vector<rect_t> layout;
+    uint32_t exchange_ticks;
+    thread_pool_t pool;
+    std::vector<subdomain_t> subs;
+    std::vector<std::vector<halo_link_t>> links;
+    bool configured = false;
+    uint64_t exchange_rounds = 0;
+    uint64_t tick = 0;
+    uint32_t world_rows = 0;
+    uint32_t world_cols = 0;
+
+    uint32_t rebalance_every = 0;
+    double rebalance_threshold = 1.2;
+    uint32_t since_check = 0;
+    std::vector<double> busy;
+    double last_migration = 0;
+    balance_stats_t balance_stats;
+    load_map_t map;
+};
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "ecosim.hpp"
+#include "slot_map.hpp"
+
+#include <vector>
+
+//Dados de cada ser rastreado, guardados fora da grade
+struct entity_record_t
+{
+    uint64_t born_tick = 0;
+    handle_t parent = NULL_HANDLE;
+    uint32_t moves = 0;
+};
+
+//Identidade estavel dos seres: um plano de handles paralelo a grade aponta
+//para um slot_map_t de registros. A cada tick, depois da fase de aplicacao, o
+//plano e refeito a partir das intencoes e vencedores do proprio tick: quem
+//fica mantem o handle, quem se move leva o handle (4 bytes) para a celula
+//nova, quem nasce ganha um registro novo e quem morre tem o seu removido.
+//
+//E uma tabela lateral: a grade continua guardando a celula compactada inteira,
+//e nada fora daqui conhece os handles. Por isso o rastreador nao entra nos
+//checkpoints (as identidades recomecam a cada attach) nem nos motores
+//particionados ou no mundo em arquivo, e a varredura de update e sequencial
+//mesmo no tick paralelo.
+class entity_tracker_t
+{
+public:
+    //Da um handle a cada ser ja presente no mundo
+    void attach(const world_t &w)
+    {
+        records.clear();
+        records.reserve(w.entity_grid.size());
+        handles.assign(w.entity_grid.size(), NULL_HANDLE);
+        next_handles.assign(w.entity_grid.size(), NULL_HANDLE);
+        for (size_t k = 0; k < w.entity_grid.size(); k++)
+        {
+            if (cellType(w.entity_grid[k]) != entity_type_t::empty) handles[k] = records.insert({w.tick, NULL_HANDLE, 0});
+        }
+    }
+
+    bool attached(const world_t &w) const { return handles.size() == w.entity_grid.size(); }
+
+    //Chamar depois de applyRows e antes de finishTick (grade nova em next_grid)
+    void update(const world_t &w)
+    {
+        using namespace ecosim;
+        for (uint32_t i = 0; i < w.rows; i++)
+        {
+            for (uint32_t j = 0; j < w.cols; j++)
+            {
+                size_t k = w.index(i, j);
+                bool was = cellType(w.entity_grid[k]) != entity_type_t::empty;
+                bool is = cellType(w.next_grid[k]) != entity_type_t::empty;
+                next_handles[k] = NULL_HANDLE;
+
+                if (was)
+                {
+                    //Uma celula ocupada nunca recebe outro ser: se continua
+                    //ocupada, e o mesmo ser
+                    if (is)
+                        next_handles[k] = handles[k];
+                    else if (!movedAway(w, i, j))
+                        records.erase(handles[k]);
+                }
+                else if (is)
+                {
+                    uint8_t from = w.winners[k];
+                    size_t src = w.index(i + DI[from], j + DJ[from]);
+                    if (claimKind(w.claims[src]) == claim_move)
+                    {
+                        next_handles[k] = handles[src];
+                        if (entity_record_t *r = records.get(handles[src])) r->moves++;
+                    }
+                    else
+                    {
+                        next_handles[k] = records.insert({w.tick + 1, handles[src], 0});
+                    }
+                }
+            }
+        }
+        handles.swap(next_handles);
+    }
+
+    handle_t handleAt(const world_t &w, uint32_t i, uint32_t j) const { return handles[w.index(i, j)]; }
+    const entity_record_t *record(handle_t h) const { return records.get(h); }
+    size_t tracked() const { return records.size(); }
+
+private:
+    //O ser em (i, j) venceu a disputa por uma celula vazia e chegou vivo nela?
+    static bool movedAway(const world_t &w, uint32_t i, uint32_t j)
+    {
+        using namespace ecosim;
+        uint8_t claim = w.claims[w.index(i, j)];
+        if (claimKind(claim) != claim_move || !claimWon(w, i, j, claim)) return false;
+        int d = claimDir(claim);
+        return cellType(w.next_grid[w.index(i + DI[d], j + DJ[d])]) != entity_type_t::empty;
+    }
+
+    slot_map_t<entity_record_t> records;
+    std::vector<handle_t> handles;
+    std::vector<handle_t> next_handles;
+};
+
+//nextIteration mantendo o plano de handles do rastreador
+inline void nextIterationTracked(world_t &w, entity_tracker_t &tracker)
+{
+    tick_counts_t counts;
+    ecosim::decideRows(w, 0, w.rows);
+    ecosim::resolveRows(w, 0, w.rows);
+    ecosim::applyRows(w, counts, 0, w.rows);
+    tracker.update(w);
+    ecosim::finishTick(w, counts);
+}
@@ -0,0 +1,508 @@
+#pragma once
+
+#include "frame_codec.hpp"
+#include "world_file.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Formato do registro de trajetoria: um cabecalho e, depois dele, um registro
+//por tick. O registro e um quadro-chave (todas as celulas em ordem linha a
+//linha, independente do layout) ou um delta: para cada celula que mudou desde
+//o tick anterior, a distancia (varint LEB128) desde a ultima celula gravada
+//mais 1 e o valor de 4 bytes. Gravados com compressao, quadros-chave e deltas
+//sao blocos de frame_codec.hpp (PACKED_KEYFRAME e PACKED_DELTA). O indice de
+//busca fica ao lado, em PATH.idx: um par (tick, posicao no arquivo) por
+//quadro-chave. Tudo em little-endian.
+struct trajectory_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t keyframe_every;
+    uint64_t seed;
+    species_params_t params;
+};
+
+struct trajectory_record_t
+{
+    uint64_t tick;
+    uint64_t bytes;
+    uint32_t kind;
+    population_t population;
+};
+
+struct trajectory_index_t
+{
+    uint64_t tick;
+    uint64_t offset;
+};
+
+namespace trajectory
+{
+    const uint32_t VERSION = 2;
+    const uint32_t KEYFRAME = 1;
+    const uint32_t DELTA = 2;
+
+    //Registros comprimidos com frame_codec.hpp (quadro inteiro ou mudancas)
+    const uint32_t PACKED_KEYFRAME = 3;
+    const uint32_t PACKED_DELTA = 4;
+
+    using frame_codec::getVarint;
+    using frame_codec::putVarint;
+}
+
+//Numeros da gravacao, para relatorio
+struct trajectory_stats_t
+{
+    uint64_t frames = 0;
+    uint64_t keyframes = 0;
+    uint64_t bytes = 0;
+    //Vezes em que o tick esperou por espaco na fila
+    uint64_t stalls = 0;
+};
+
+//Grava a trajetoria de uma simulacao. A cada tick, push copia a grade (na
+//ordem de armazenamento, um memcpy) para uma vaga de uma fila circular sem
+//trava com um produtor e um consumidor; a thread de escrita compara a grade
+//com a do tick anterior, codifica o delta e anexa ao arquivo. As marcas de
+//ladrilhos sujos do tick so registram mudancas de especie e todo ser vivo
+//envelhece a cada tick, entao o delta e calculado pela escrita, fora do tick.
+//Se a fila enche, o tick espera (a trajetoria nunca perde ticks).
+class trajectory_recorder_t
+{
+public:
+    static const uint32_t SLOTS = 4;
+
+    trajectory_recorder_t() = default;
+    ~trajectory_recorder_t()
+    {
+        try
+        {
+            finish();
+        }
+        catch (const std::exception &)
+        {
+        }
+    }
+
+    trajectory_recorder_t(const trajectory_recorder_t &) = delete;
+    trajectory_recorder_t &operator=(const trajectory_recorder_t &) = delete;
+
+    //Comeca uma trajetoria nova em path (substitui o arquivo) a partir do estado
+    //de w; com packed, os registros sao comprimidos por frame_codec.hpp
+    void start(const std::string &path, const world_t &w, uint32_t keyframeEvery = 100, bool packed = false)
+    {
+        finish();
+        trajectory_header_t h{};
+        std::memcpy(h.magic, "ECOTRAJ1", 8);
+        h.version = trajectory::VERSION;
+        h.rows = w.rows;
+        h.cols = w.cols;
+        h.keyframe_every = std::max(keyframeEvery, 1u);
+        h.seed = w.seed;
+        h.params = w.params;
+        header = h;
+
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        index_fd = ::open((path + ".idx").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0 || index_fd < 0) throw world_file::error("create " + path);
+        world_file::writeAll(fd, &h, sizeof(h), 0, path);
+        offset = sizeof(h);
+        file = path;
+
+        row_base = w.row_base;
+        col_base = w.col_base;
+        for (frame_t &f : ring) f.cells = grid_vector_t<cell_t>(w.entity_grid.size());
+        previous = grid_vector_t<cell_t>(w.entity_grid.size());
+        compress = packed;
+        //Pior caso de um delta: toda celula mudou (1 byte de distancia + o valor)
+        if (!compress) payload.resize((size_t)w.rows * w.cols * (sizeof(cell_t) + 1) + 16);
+        head.store(0);
+        tail.store(0);
+        closing.store(false);
+        first = true;
+        error.clear();
+        frames.store(0);
+        keyframes.store(0);
+        bytes.store(0);
+        stalls.store(0);
+        writer = std::thread([this] { loop(); });
+        push(w);
+    }
+
+    bool recording() const { return writer.joinable(); }
+
+    //Enfileira o estado de w (chamar depois de cada tick)
+    void push(const world_t &w)
+    {
+        if (!recording()) return;
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == SLOTS)
+        {
+            stalls.fetch_add(1, std::memory_order_relaxed);
+            while (h - tail.load(std::memory_order_acquire) == SLOTS) std::this_thread::yield();
+        }
+        frame_t &f = ring[h % SLOTS];
+        std::copy(w.entity_grid.begin(), w.entity_grid.end(), f.cells.begin());
+        f.tick = w.tick;
+        f.population = w.population;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    //Grava o que falta na fila e fecha a trajetoria
+    void finish()
+    {
+        if (!recording()) return;
+        closing.store(true, std::memory_order_release);
+        writer.join();
+        ::close(fd);
+        ::close(index_fd);
+        fd = index_fd = -1;
+        if (!error.empty()) throw std::runtime_error(error);
+    }
+
+    trajectory_stats_t stats() const
+    {
+        trajectory_stats_t s;
+        s.frames = frames.load(std::memory_order_relaxed);
+        s.keyframes = keyframes.load(std::memory_order_relaxed);
+        s.bytes = bytes.load(std::memory_order_relaxed);
+        s.stalls = stalls.load(std::memory_order_relaxed);
+        return s;
+    }
+
+private:
+    struct frame_t
+    {
+        uint64_t tick = 0;
+        population_t population;
+        grid_vector_t<cell_t> cells;
+    };
+
+    void loop()
+    {
+        bool failed = false;
+        while (true)
+        {
+            uint64_t t = tail.load(std::memory_order_relaxed);
+            if (t == head.load(std::memory_order_acquire))
+            {
+                if (closing.load(std::memory_order_acquire) && t == head.load(std::memory_order_acquire)) return;
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+                continue;
+            }
+            //Depois de um erro de escrita a fila so e esvaziada, para nao travar o tick
+            frame_t &f = ring[t % SLOTS];
+            if (!failed)
+            {
+                try
+                {
+                    encode(f);
+                }
+                catch (const std::exception &e)
+                {
+                    error = e.what();
+                    failed = true;
+                }
+            }
+            //A vaga troca de buffer com o quadro anterior: o produtor so volta
+            //a ela depois que tail avanca, e sempre sobrescreve a grade inteira
+            std::swap(previous, f.cells);
+            tail.store(t + 1, std::memory_order_release);
+        }
+    }
+
+    void encode(const frame_t &f)
+    {
+        bool key = first || f.tick % header.keyframe_every == 0 || f.tick != last_tick + 1;
+        const uint32_t rows = header.rows, cols = header.cols;
+        const cell_t *cells = f.cells.data(), *before = previous.data();
+        const uint8_t *data = payload.data();
+        uint64_t length = 0;
+        if (compress)
+        {
+            block.clear();
+            if (key)
+            {
+                encoder.beginFrame((uint64_t)rows * cols);
+                for (uint32_t i = 0; i < rows; i++)
+                {
+                    for (uint32_t j = 0; j < cols; j++) encoder.add(cells[row_base[i] + col_base[j]]);
+                }
+            }
+            else
+            {
+                encoder.beginChanges((uint64_t)rows * cols);
+                uint64_t k = 0;
+                for (uint32_t i = 0; i < rows; i++)
+                {
+                    const cell_t *row = cells + row_base[i], *rowBefore = before + row_base[i];
+                    for (uint32_t j = 0; j < cols; j++, k++)
+                    {
+                        if (row[col_base[j]].bits != rowBefore[col_base[j]].bits) encoder.change(k, row[col_base[j]], rowBefore[col_base[j]]);
+                    }
+                }
+            }
+            encoder.end(block);
+            data = block.data();
+            length = block.size();
+        }
+        else if (key)
+        {
+            uint8_t *out = payload.data();
+            for (uint32_t i = 0; i < rows; i++)
+            {
+                for (uint32_t j = 0; j < cols; j++, out += sizeof(cell_t)) std::memcpy(out, &cells[row_base[i] + col_base[j]], sizeof(cell_t));
+            }
+            length = out - data;
+        }
+        else
+        {
+            uint8_t *out = payload.data();
+            uint64_t next = 0, k = 0;
+            for (uint32_t i = 0; i < rows; i++)
+            {
+                const cell_t *row = cells + row_base[i], *rowBefore = before + row_base[i];
+                for (uint32_t j = 0; j < cols; j++, k++)
+                {
+                    if (row[col_base[j]].bits == rowBefore[col_base[j]].bits) continue;
+                    out = trajectory::putVarint(out, k - next);
+                    std::memcpy(out, &row[col_base[j]], sizeof(cell_t));
+                    out += sizeof(cell_t);
+                    next = k + 1;
+                }
+            }
+            length = out - data;
+        }
+
+        trajectory_record_t r{};
+        r.tick = f.tick;
+        r.bytes = length;
+        r.kind = key ? (compress ? trajectory::PACKED_KEYFRAME : trajectory::KEYFRAME) : (compress ? trajectory::PACKED_DELTA : trajectory::DELTA);
+        r.population = f.population;
+        if (key)
+        {
+            trajectory_index_t entry{f.tick, offset};
+            world_file::writeAll(index_fd, &entry, sizeof(entry), (uint64_t)keyframes.load(std::memory_order_relaxed) * sizeof(entry), file + ".idx");
+            keyframes.fetch_add(1, std::memory_order_relaxed);
+        }
+        world_file::writeAll(fd, &r, sizeof(r), offset, file);
+        world_file::writeAll(fd, data, length, offset + sizeof(r), file);
+        offset += sizeof(r) + length;
+        frames.fetch_add(1, std::memory_order_relaxed);
+        bytes.store(offset, std::memory_order_relaxed);
+        first = false;
+        last_tick = f.tick;
+    }
+
+    trajectory_header_t header{};
+    std::string file;
+    int fd = -1;
+    int index_fd = -1;
+    uint64_t offset = 0;
+    std::vector<size_t> row_base;
+    std::vector<uint32_t> col_base;
+
+    //Fila: o tick escreve em ring[head % SLOTS], a escrita le de ring[tail % SLOTS]
+    frame_t ring[SLOTS];
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    std::atomic<bool> closing{false};
+    std::thread writer;
+
+    //So a thread de escrita usa
+    grid_vector_t<cell_t> previous;
+    std::vector<uint8_t> payload;
+    bool compress = false;
+    frame_codec::frame_encoder_t encoder;
+    std::vector<uint8_t> block;
+    bool first = true;
+    uint64_t last_tick = 0;
+    std::string error;
+
+    std::atomic<uint64_t> frames{0};
+    std::atomic<uint64_t> keyframes{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> stalls{0};
+};
+
+//Le uma trajetoria gravada: seek(tick) parte do ultimo quadro-chave ate o tick
+//pelo indice e aplica os deltas seguintes; ticks seguintes continuam de onde a
+//leitura parou, sem voltar ao quadro-chave (o mundo nao pode ser alterado por
+//fora entre as chamadas).
+class trajectory_reader_t
+{
+public:
+    trajectory_reader_t() = default;
+    ~trajectory_reader_t() { close(); }
+
+    trajectory_reader_t(const trajectory_reader_t &) = delete;
+    trajectory_reader_t &operator=(const trajectory_reader_t &) = delete;
+
+    void open(const std::string &path)
+    {
+        close();
+        fd = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd < 0 || ::fstat(fd, &st) != 0) throw world_file::error("open " + path);
+        size = (uint64_t)st.st_size;
+        file = path;
+        if (size < sizeof(header)) throw std::runtime_error(path + ": not a trajectory");
+        world_file::readAll(fd, &header, sizeof(header), 0, path);
+        if (std::memcmp(header.magic, "ECOTRAJ1", 8) != 0) throw std::runtime_error(path + ": not a trajectory");
+        if (header.version < 1 || header.version > trajectory::VERSION) throw std::runtime_error(path + ": unsupported trajectory version " + std::to_string(header.version));
+
+        //Indice dos quadros-chave; um registro cortado no fim (gravacao
+        //interrompida) e ignorado
+        index.clear();
+        int ifd = ::open((path + ".idx").c_str(), O_RDONLY);
+        if (ifd >= 0)
+        {
+            struct stat ist;
+            if (::fstat(ifd, &ist) == 0)
+            {
+                index.resize((size_t)ist.st_size / sizeof(trajectory_index_t));
+                world_file::readAll(ifd, index.data(), index.size() * sizeof(trajectory_index_t), 0, path + ".idx");
+            }
+            ::close(ifd);
+        }
+        while (!index.empty() && index.back().offset + sizeof(trajectory_record_t) > size) index.pop_back();
+        if (index.empty()) throw std::runtime_error(path + ": trajectory has no keyframe index");
+
+        //Ultimo tick completo: percorre os registros depois do ultimo quadro-chave
+        last = index.back().tick;
+        for (uint64_t at = index.back().offset; at + sizeof(trajectory_record_t) <= size;)
+        {
+            trajectory_record_t r;
+            world_file::readAll(fd, &r, sizeof(r), at, path);
+            if (at + sizeof(r) + r.bytes > size) break;
+            last = r.tick;
+            at += sizeof(r) + r.bytes;
+        }
+        position = 0;
+    }
+
+    void close()
+    {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+        position = 0;
+    }
+
+    uint32_t rows() const { return header.rows; }
+    uint32_t cols() const { return header.cols; }
+    uint64_t firstTick() const { return index.front().tick; }
+    uint64_t lastTick() const { return last; }
+    uint32_t keyframeEvery() const { return header.keyframe_every; }
+    const std::vector<trajectory_index_t> &keyframes() const { return index; }
+
+    //Tick do quadro-chave de onde parte a busca por tick
+    uint64_t keyframeBefore(uint64_t tick) const { return keyAt(tick)->tick; }
+
+    //Monta em w o estado do tick (entre firstTick e lastTick)
+    void seek(uint64_t tick, world_t &w)
+    {
+        if (tick < firstTick() || tick > lastTick()) throw std::out_of_range("tick " + std::to_string(tick) + " is not in the trajectory");
+        if (w.rows != header.rows || w.cols != header.cols || w.row0 != 0 || w.col0 != 0) w.resize(header.rows, header.cols);
+
+        auto key = keyAt(tick);
+        bool resume = position && at_tick <= tick && at_tick >= key->tick && reader_grid == w.entity_grid.data();
+        uint64_t at = resume ? position : key->offset;
+        if (resume && at_tick == tick) return;
+
+        while (true)
+        {
+            trajectory_record_t r;
+            world_file::readAll(fd, &r, sizeof(r), at, file);
+            buffer.resize(r.bytes);
+            world_file::readAll(fd, buffer.data(), r.bytes, at + sizeof(r), file);
+            apply(r, w);
+            at += sizeof(r) + r.bytes;
+            if (r.tick == tick) break;
+        }
+        position = at;
+        at_tick = tick;
+        reader_grid = w.entity_grid.data();
+        w.tick = tick;
+        w.seed = header.seed;
+        w.params = header.params;
+        w.last_counts = tick_counts_t();
+        w.touchAll();
+    }
+
+private:
+    std::vector<trajectory_index_t>::const_iterator keyAt(uint64_t tick) const
+    {
+        return std::upper_bound(index.begin(), index.end(), tick, [](uint64_t t, const trajectory_index_t &e) { return t < e.tick; }) - 1;
+    }
+
+    void apply(const trajectory_record_t &r, world_t &w)
+    {
+        const uint8_t *p = buffer.data(), *end = p + buffer.size();
+        uint64_t cells = (uint64_t)header.rows * header.cols;
+        if (r.kind == trajectory::PACKED_KEYFRAME)
+        {
+            uint32_t i = 0, j = 0;
+            decoder.frame(p, buffer.size(), cells, [&](cell_t c) {
+                w.at(i, j) = c;
+                if (++j == header.cols)
+                {
+                    j = 0;
+                    i++;
+                }
+            });
+        }
+        else if (r.kind == trajectory::PACKED_DELTA)
+        {
+            decoder.changes(p, buffer.size(), cells, [&](uint64_t k) -> cell_t & { return w.at(k / header.cols, k % header.cols); });
+        }
+        else if (r.kind == trajectory::KEYFRAME)
+        {
+            if (buffer.size() != (size_t)header.rows * header.cols * sizeof(cell_t)) throw std::runtime_error(file + ": corrupt keyframe");
+            for (uint32_t i = 0; i < header.rows; i++)
+            {
+                for (uint32_t j = 0; j < header.cols; j++, p += sizeof(cell_t)) std::memcpy(&w.at(i, j), p, sizeof(cell_t));
+            }
+        }
+        else
+        {
+            uint64_t k = 0;
+            while (p < end)
+            {
+                k += trajectory::getVarint(p, end);
+                if (k >= cells || end - p < (ptrdiff_t)sizeof(cell_t)) throw std::runtime_error(file + ": corrupt delta");
+                std::memcpy(&w.at(k / header.cols, k % header.cols), p, sizeof(cell_t));
+                p += sizeof(cell_t);
+                k++;
+            }
+        }
+        w.population = r.population;
+    }
+
+    trajectory_header_t header{};
+    std::string file;
+    int fd = -1;
+    uint64_t size = 0;
+    uint64_t last = 0;
+    std::vector<trajectory_index_t> index;
+    std::vector<uint8_t> buffer;
+    frame_codec::frame_decoder_t decoder;
+
+    //Onde a ultima leitura parou, para continuar sem voltar ao quadro-chave
+    uint64_t position = 0;
+    uint64_t at_tick = 0;
+    const cell_t *reader_grid = nullptr;
+};
@@ -0,0 +1,268 @@
+#pragma once
+
+#include "ecosim.hpp"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+//Cabecalho dos arquivos de mundo (checkpoints e mundos mapeados). Depois dele,
+//cada um alinhado a pagina: o estado do gerador (texto de operator<< do
+//mt19937) e os planos presentes, na ordem de armazenamento do layout. Um
+//checkpoint guarda so a grade atual; um mundo mapeado guarda os dois planos de
+//celulas (current diz qual deles e a grade atual), as intencoes e os vencedores.
+struct world_file_header_t
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;
+    uint32_t rows;
+    uint32_t cols;
+    uint64_t tick;
+    uint64_t seed;
+    species_params_t params;
+    population_t population;
+    uint32_t current;
+    uint32_t planes;
+    uint64_t cells;
+    uint64_t rng_offset;
+    uint64_t rng_bytes;
+    uint64_t offsets[4];
+    uint64_t file_bytes;
+};
+
+namespace world_file
+{
+    const uint32_t VERSION = 2;
+
+    //Espaco reservado para o estado do gerador (o texto do mt19937 tem ~7 KB)
+    const uint64_t RNG_BYTES = 16384;
+
+    inline std::runtime_error error(const std::string &what) { return std::runtime_error(what + ": " + std::strerror(errno)); }
+
+    inline uint64_t pageAlign(uint64_t n)
+    {
+        uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+        return (n + page - 1) & ~(page - 1);
+    }
+
+    inline uint64_t planeBytes(uint64_t cells, int p) { return cells * (p < 2 ? sizeof(cell_t) : sizeof(uint8_t)); }
+
+    //Cabecalho de w com os primeiros `planes` planos (1 = checkpoint, 4 = mundo mapeado)
+    inline world_file_header_t describe(const world_t &w, uint32_t planes)
+    {
+        world_file_header_t h{};
+        std::memcpy(h.magic, "ECOWORLD", 8);
+        h.version = VERSION;
+        h.layout = w.layout;
+        h.rows = w.rows;
+        h.cols = w.cols;
+        h.tick = w.tick;
+        h.seed = w.seed;
+        h.params = w.params;
+        h.population = w.population;
+        h.planes = planes;
+        h.cells = w.entity_grid.size();
+        h.rng_offset = pageAlign(sizeof(h));
+        uint64_t offset = h.rng_offset + RNG_BYTES;
+        for (uint32_t p = 0; p < planes; p++)
+        {
+            h.offsets[p] = offset;
+            offset += pageAlign(planeBytes(h.cells, p));
+        }
+        h.file_bytes = offset;
+        return h;
+    }
+
+    inline std::string rngState(const world_t &w)
+    {
+        std::ostringstream out;
+        out << w.gen;
+        if (out.str().size() > RNG_BYTES) throw std::length_error("random generator state does not fit the world file");
+        return out.str();
+    }
+
+    inline void check(const world_file_header_t &h, uint64_t fileBytes, const std::string &path)
+    {
+        if (fileBytes < sizeof(h) || std::memcmp(h.magic, "ECOWORLD", 8) != 0) throw std::runtime_error(path + ": not a world file");
+        if (h.version != VERSION) throw std::runtime_error(path + ": unsupported world file version " + std::to_string(h.version));
+        if (h.file_bytes != fileBytes) throw std::runtime_error(path + ": truncated world file");
+        bool fits = h.planes >= 1 && h.planes <= 4 && h.current < std::min(h.planes, 2u) && h.rng_bytes <= RNG_BYTES &&
+                    h.rng_offset + RNG_BYTES <= fileBytes;
+        for (uint32_t p = 0; fits && p < h.planes; p++) fits = h.offsets[p] + planeBytes(h.cells, p) <= fileBytes;
+        if (!fits) throw std::runtime_error(path + ": corrupt world file");
+    }
+
+    //O cabecalho descreve uma grade com as dimensoes e o layout de w
+    inline bool fits(const world_file_header_t &h, const world_t &w)
+    {
+        return w.layout == h.layout && w.rows == h.rows && w.cols == h.cols && w.row0 == 0 && w.col0 == 0 && w.world_rows == h.rows &&
+               w.world_cols == h.cols;
+    }
+
+    //Passa para w tudo o que o cabecalho descreve. A grade so e refeita se as
+    //dimensoes ou o layout mudam; com clear = false os buffers novos ficam sem
+    //inicializar, para quem vai substitui-los (ver mapped_world_t). Se a grade
+    //nao e refeita, um erro nao deixa nada de w alterado.
+    inline void adopt(const world_file_header_t &h, const char *rng, world_t &w, bool clear)
+    {
+        std::mt19937 gen;
+        if (h.rng_bytes)
+        {
+            std::istringstream in(std::string(rng, h.rng_bytes));
+            in >> gen;
+            if (!in) throw std::runtime_error("world file holds a corrupt generator state");
+        }
+        else
+            gen.seed((std::mt19937::result_type)(h.seed ^ (h.seed >> 32)));
+
+        if (!fits(h, w))
+        {
+            w.layout = (grid_layout_t)h.layout;
+            w.resizeWindow(h.rows, h.cols, 0, 0, h.rows, h.cols, clear);
+        }
+        if (w.entity_grid.size() != h.cells) throw std::runtime_error("world file grid size does not match its layout");
+        w.params = h.params;
+        w.population = h.population;
+        w.last_counts = tick_counts_t();
+        w.seed = h.seed;
+        w.tick = h.tick;
+        w.gen = gen;
+        w.touchAll();
+    }
+
+    inline void writeAll(int fd, const void *data, uint64_t bytes, uint64_t offset, const std::string &path)
+    {
+        const char *p = static_cast<const char *>(data);
+        while (bytes)
+        {
+            ssize_t n = ::pwrite(fd, p, std::min<uint64_t>(bytes, 1u << 30), (off_t)offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw error("write " + path);
+            p += n;
+            offset += n;
+            bytes -= n;
+        }
+    }
+
+    inline void readAll(int fd, void *data, uint64_t bytes, uint64_t offset, const std::string &path)
+    {
+        char *p = static_cast<char *>(data);
+        while (bytes)
+        {
+            ssize_t n = ::pread(fd, p, std::min<uint64_t>(bytes, 1u << 30), (off_t)offset);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw error("read " + path);
+            p += n;
+            offset += n;
+            bytes -= n;
+        }
+    }
+
+    inline world_file_header_t readHeader(const std::string &path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw error("open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            std::runtime_error e = error("stat " + path);
+            ::close(fd);
+            throw e;
+        }
+        world_file_header_t h{};
+        ssize_t n = ::pread(fd, &h, sizeof(h), 0);
+        ::close(fd);
+        check(h, n == (ssize_t)sizeof(h) ? (uint64_t)st.st_size : 0, path);
+        return h;
+    }
+
+    //Grava um checkpoint de w: cabecalho, gerador e a grade atual, em chamadas
+    //grandes de write direto do buffer. O arquivo e escrito ao lado e renomeado
+    //no fim, entao um checkpoint antigo nunca fica pela metade. Devolve os bytes.
+    inline uint64_t save(const std::string &path, const world_t &w)
+    {
+        world_file_header_t h = describe(w, 1);
+        std::string rng = rngState(w);
+        h.rng_bytes = rng.size();
+
+        std::string partial = path + ".partial";
+        int fd = ::open(partial.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) throw error("create " + partial);
+        try
+        {
+            if (::ftruncate(fd, (off_t)h.file_bytes) != 0) throw error("resize " + partial);
+            writeAll(fd, &h, sizeof(h), 0, partial);
+            writeAll(fd, rng.data(), rng.size(), h.rng_offset, partial);
+            writeAll(fd, w.entity_grid.data(), planeBytes(h.cells, 0), h.offsets[0], partial);
+            if (::fdatasync(fd) != 0) throw error("sync " + partial);
+        }
+        catch (...)
+        {
+            ::close(fd);
+            ::unlink(partial.c_str());
+            throw;
+        }
+        ::close(fd);
+        if (::rename(partial.c_str(), path.c_str()) != 0) throw error("rename " + partial);
+        return h.file_bytes;
+    }
+
+    //Restaura em w um checkpoint (ou um mundo mapeado). Tudo e lido antes de
+    //mexer em w: se as dimensoes e o layout nao mudam, a grade vai para um
+    //buffer temporario e e copiada para os buffers de w (inclusive quando w
+    //esta sobre um arquivo mapeado); se mudam, o mundo novo e montado a parte
+    //e movido para w. Um arquivo curto ou corrompido deixa w como estava.
+    inline void load(const std::string &path, world_t &w)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw error("open " + path);
+        world_file_header_t h{};
+        std::string rng;
+        grid_vector_t<cell_t> cells;
+        world_t fresh;
+        bool reuse = false;
+        try
+        {
+            struct stat st;
+            if (::fstat(fd, &st) != 0) throw error("stat " + path);
+            readAll(fd, &h, std::min<uint64_t>(sizeof(h), (uint64_t)st.st_size), 0, path);
+            check(h, (uint64_t)st.st_size, path);
+            rng.assign(h.rng_bytes, '\0');
+            readAll(fd, &rng[0], h.rng_bytes, h.rng_offset, path);
+            reuse = fits(h, w);
+            if (reuse)
+            {
+                cells = grid_vector_t<cell_t>(h.cells);
+                readAll(fd, cells.data(), planeBytes(h.cells, 0), h.offsets[h.current], path);
+            }
+            else
+            {
+                adopt(h, rng.data(), fresh, true);
+                readAll(fd, fresh.entity_grid.data(), planeBytes(h.cells, 0), h.offsets[h.current], path);
+            }
+        }
+        catch (...)
+        {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+
+        if (reuse)
+        {
+            adopt(h, rng.data(), w, true);
+            std::copy(cells.begin(), cells.end(), w.entity_grid.begin());
+        }
+        else
+            w = std::move(fresh);
+    }
+}